@@ -0,0 +1,85 @@
+// measures the heap allocations and time taken to unpack and copy typical rows and keys.  run with no arguments;
+// the allocation counts are only available with glibc, where we can wrap malloc.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "../src/message_pack/flat_row.h"
+
+using namespace std;
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+static size_t allocations = 0;
+
+extern "C" void *malloc(size_t size) {
+	allocations++;
+	return __libc_malloc(size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+	allocations++;
+	return __libc_realloc(ptr, size);
+}
+#define ALLOCATIONS_COUNTED true
+#else
+static size_t allocations = 0;
+#define ALLOCATIONS_COUNTED false
+#endif
+
+struct ByteStream {
+	ByteStream(): pos(0) {}
+
+	inline void write(const uint8_t *src, size_t bytes) { data.insert(data.end(), src, src + bytes); }
+	inline void read(uint8_t *dest, size_t bytes) { memcpy(dest, data.data() + pos, bytes); pos += bytes; }
+	inline const uint8_t *peek(size_t &bytes_available) { bytes_available = data.size() - pos; return data.data() + pos; }
+	inline void skip(size_t bytes) { pos += bytes; }
+	inline void flush() {}
+
+	vector<uint8_t> data;
+	size_t pos;
+};
+
+const size_t ROWS = 1000000;
+
+int main(int argc, char *argv[]) {
+	// a typical row: an integer key, a foreign key, a boolean, a nullable column, a short string and a longer one
+	ByteStream stream;
+	Packer<ByteStream> packer(stream);
+	for (size_t row = 0; row < ROWS; row++) {
+		pack_array_length(packer, 6);
+		packer << (int64_t)row*1000 << (int64_t)(row % 977) << (row % 2 == 0) << nullptr << string("status") << string("a rather longer description column value");
+	}
+
+	Unpacker<ByteStream> unpacker(stream);
+	PackedRow row;
+	vector<PackedRow> keys(1);
+
+	size_t allocations_before = allocations;
+	auto started = chrono::steady_clock::now();
+	for (size_t n = 0; n < ROWS; n++) {
+		unpacker >> row;
+		keys[0].resize(1);
+		keys[0][0] = row[0]; // as RowLastKey and primary_key_of do
+	}
+	auto elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+	size_t allocations_made = allocations - allocations_before;
+
+	cout << "unpacked " << ROWS << " rows in " << elapsed.count()/1000.0 << "ms";
+	if (ALLOCATIONS_COUNTED) cout << " making " << allocations_made << " allocations (" << (double)allocations_made/ROWS << " per row)";
+	cout << endl;
+
+	// and as the to end does now, into a FlatRow
+	stream.pos = 0;
+	FlatRow flat_row;
+	started = chrono::steady_clock::now();
+	for (size_t n = 0; n < ROWS; n++) {
+		unpacker >> flat_row;
+	}
+	elapsed = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+	cout << "unpacked " << ROWS << " rows into a FlatRow in " << elapsed.count()/1000.0 << "ms" << endl;
+	return 0;
+}
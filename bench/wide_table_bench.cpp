@@ -0,0 +1,74 @@
+// measures the time taken to encode the values of wide rows into SQL using the general encode() function and
+// using the column encoders chosen once for the table.  run with no arguments.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include "../src/schema.h"
+#include "../src/message_pack/flat_row.h"
+#include "../src/encode_packed.h"
+
+using namespace std;
+
+struct StubClient {
+	inline void append_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length) { result.append((const char *)value, length); }
+};
+
+const size_t COLUMNS = 100;
+const size_t ROWS = 100000;
+
+template <typename Encode>
+chrono::microseconds time_encoding(const vector<FlatRow> &rows, Encode append_value, size_t &bytes) {
+	string sql;
+	bytes = 0;
+	auto started = chrono::steady_clock::now();
+	for (const FlatRow &row : rows) {
+		sql.clear();
+		for (size_t n = 0; n < row.size(); n++) {
+			if (n > 0) sql += ',';
+			append_value(sql, n, row[n]);
+		}
+		bytes += sql.size();
+	}
+	return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+}
+
+int main(int argc, char *argv[]) {
+	// a wide table cycling through integer, string, boolean, and date-time columns, with some NULLs
+	Columns columns;
+	for (size_t n = 0; n < COLUMNS; n++) {
+		static const string types[] = { ColumnTypes::SINT, ColumnTypes::VCHR, ColumnTypes::BOOL, ColumnTypes::DTTM };
+		columns.push_back(Column("col" + to_string(n), true, DefaultType::no_default, "", types[n % 4]));
+	}
+
+	vector<FlatRow> rows(ROWS);
+	for (size_t row = 0; row < ROWS; row++) {
+		for (size_t n = 0; n < COLUMNS; n++) {
+			if ((row + n) % 17 == 0) {
+				rows[row] << nullptr;
+			} else switch (n % 4) {
+				case 0: rows[row] << (int64_t)(row*n); break;
+				case 1: rows[row] << string("value ") + to_string(row); break;
+				case 2: rows[row] << (row % 2 == 0); break;
+				case 3: rows[row] << string("2016-01-01 12:34:56"); break;
+			}
+		}
+	}
+
+	StubClient client;
+	ColumnEncoders<StubClient> encoders(columns);
+	size_t general_bytes, specialized_bytes;
+
+	auto general = time_encoding(rows, [&](string &sql, size_t n, const PackedValueView &value) { sql += encode(client, columns[n], value); }, general_bytes);
+	auto specialized = time_encoding(rows, [&](string &sql, size_t n, const PackedValueView &value) { encoders.append(client, columns, n, value, sql); }, specialized_bytes);
+
+	if (general_bytes != specialized_bytes) {
+		cerr << "encoders produced different output" << endl;
+		return 1;
+	}
+
+	cout << "encoded " << ROWS << " rows of " << COLUMNS << " columns in " << general.count()/1000.0 << "ms using encode(), "
+		 << specialized.count()/1000.0 << "ms using the table's column encoders" << endl;
+	return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+// hands out memory from large blocks, all of which is released at once by reset() rather than freed piece by
+// piece.  the blocks are kept for reuse after a reset, so once it has grown to its working size an arena makes
+// no further calls to the heap allocator, which is shared by all the workers in the process; allocations too
+// big to fit sensibly in a block get blocks of their own, which are freed by reset().
+class Arena {
+public:
+	static const size_t DEFAULT_BLOCK_SIZE = 1024*1024;
+	static const size_t DEFAULT_ALIGNMENT = 2*sizeof(void*);
+
+	Arena(size_t block_size = DEFAULT_BLOCK_SIZE): block_size(block_size), current_block(0), current_block_used(0), bytes_used(0) {}
+
+	~Arena() {
+		reset();
+		for (uint8_t *block : blocks) free(block);
+	}
+
+	void *allocate(size_t bytes, size_t alignment = DEFAULT_ALIGNMENT) {
+		bytes_used += bytes;
+
+		if (bytes > block_size/4) {
+			uint8_t *block = (uint8_t *)malloc(bytes);
+			if (!block) throw std::bad_alloc();
+			large_blocks.push_back(block);
+			return block;
+		}
+
+		size_t offset = (current_block_used + alignment - 1) & ~(alignment - 1);
+		if (current_block == blocks.size() || offset + bytes > block_size) {
+			if (current_block < blocks.size()) current_block++;
+			if (current_block == blocks.size()) {
+				uint8_t *block = (uint8_t *)malloc(block_size);
+				if (!block) throw std::bad_alloc();
+				blocks.push_back(block);
+			}
+			offset = 0;
+		}
+		current_block_used = offset + bytes;
+		return blocks[current_block] + offset;
+	}
+
+	template <typename T>
+	inline T *allocate_array(size_t count) {
+		return static_cast<T *>(allocate(count*sizeof(T), alignof(T)));
+	}
+
+	inline uint8_t *copy(const uint8_t *src, size_t bytes) {
+		uint8_t *dest = static_cast<uint8_t *>(allocate(bytes, 1));
+		memcpy(dest, src, bytes);
+		return dest;
+	}
+
+	// releases everything allocated so far; nothing is destroyed, so only use the arena for trivially destructible objects
+	void reset() {
+		for (uint8_t *block : large_blocks) free(block);
+		large_blocks.clear();
+		current_block = 0;
+		current_block_used = 0;
+		bytes_used = 0;
+	}
+
+	inline size_t used() const { return bytes_used; }
+
+private:
+	size_t block_size;
+	std::vector<uint8_t *> blocks;
+	std::vector<uint8_t *> large_blocks;
+	size_t current_block;
+	size_t current_block_used;
+	size_t bytes_used;
+
+	// forbid copying
+	Arena(const Arena &copy_from);
+	Arena &operator=(const Arena &copy_from);
+};
+
+#endif
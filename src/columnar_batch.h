@@ -0,0 +1,256 @@
+#ifndef COLUMNAR_BATCH_H
+#define COLUMNAR_BATCH_H
+
+#include <vector>
+#include "command.h"
+#include "message_pack/flat_row.h"
+
+const size_t MAX_COLUMNAR_BATCH_ROWS = 1024;
+const size_t MAX_COLUMNAR_BATCH_BYTES = 1024*1024; // so that tables with big values don't make us buffer a lot
+
+// when the rows encoding is set to columnar, the response to a rows command is a series of batches instead of a
+// series of rows, still terminated by an empty array.  each batch is an array holding the number of rows in the
+// batch followed by one chunk for each column, which is a raw string made up of a byte giving the chunk's
+// encoding, a bitmap with a bit set for each row whose value is NULL, and then the non-NULL values, in one of
+// these encodings.  keeping each column's values together and sending integers and strings as the difference
+// from the previous row's value makes the stream much more compressible, since key columns, timestamps and
+// similar columns tend to change only slightly from one row to the next.
+enum ColumnChunkEncoding {
+	packed_column = 0,   // each value as a varint length followed by the packed value, used for any other types
+	integer_column = 1,  // each value as the zigzag varint difference from the previous value (starting from 0)
+	string_column = 2,   // each value as a varint length shared with the previous value, then a varint length and the remaining bytes
+};
+
+inline void append_varint(PackedValue &buffer, uint64_t value) {
+	while (value >= 0x80) {
+		*buffer.extend(1) = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*buffer.extend(1) = value;
+}
+
+inline bool packed_integer(const PackedValueView &value, int64_t &result) {
+	uint8_t leader = value.leader();
+	if (leader == MSGPACK_UINT64 && (value.data()[1] & 0x80)) return false; // too big for an int64_t
+	if (leader > MSGPACK_POSITIVE_FIXNUM_MAX && leader < MSGPACK_NEGATIVE_FIXNUM_MIN && (leader < MSGPACK_UINT8 || leader > MSGPACK_INT64)) return false;
+	VectorReadStream stream(value);
+	Unpacker<VectorReadStream> unpacker(stream);
+	result = unpacker.template next<int64_t>();
+	return true;
+}
+
+// wraps the packer given to pack_row_into, collecting rows and sending them as batches
+template <typename OutputStream>
+struct ColumnarBatchPacker {
+	ColumnarBatchPacker(Packer<OutputStream> &packer): packer(packer), rows_used(0), bytes_used(0) {}
+
+	inline void start_row(size_t columns) {
+		if (rows_used) bytes_used += current_row().encoded_size();
+		if (rows_used == MAX_COLUMNAR_BATCH_ROWS || bytes_used > MAX_COLUMNAR_BATCH_BYTES) flush();
+		if (rows_used == rows.size()) rows.resize(rows_used + 1);
+		rows_used++;
+		current_row().clear();
+		current_row().reserve(columns);
+	}
+
+	inline FlatRow &current_row() {
+		return rows[rows_used - 1];
+	}
+
+	// must be called after the last row in the response
+	void flush() {
+		if (!rows_used) return;
+		size_t columns = rows[0].size();
+		pack_array_length(packer, columns + 1);
+		packer << rows_used;
+		for (size_t column_number = 0; column_number < columns; column_number++) {
+			encode_column(column_number);
+			pack_raw(packer, chunk.data(), chunk.size());
+		}
+		rows_used = 0;
+		bytes_used = 0;
+	}
+
+	void encode_column(size_t column_number) {
+		// see which encoding this batch's values allow
+		bool integers = true, strings = true;
+		int64_t integer_value;
+		const uint8_t *string_data;
+		size_t string_length;
+
+		for (size_t row_number = 0; row_number < rows_used; row_number++) {
+			PackedValueView value(rows[row_number][column_number]);
+			if (!value.is_nil()) {
+				integers = integers && packed_integer(value, integer_value);
+				strings = strings && value.raw_bytes(string_data, string_length);
+			}
+		}
+
+		chunk.clear();
+		*chunk.extend(1) = (integers ? integer_column : strings ? string_column : packed_column);
+
+		uint8_t *nulls = chunk.extend((rows_used + 7)/8); // nb. invalidated by the next extend() call
+		memset(nulls, 0, (rows_used + 7)/8);
+		for (size_t row_number = 0; row_number < rows_used; row_number++) {
+			if (rows[row_number][column_number].is_nil()) nulls[row_number/8] |= (1 << (row_number % 8));
+		}
+
+		uint64_t previous_integer = 0;
+		const uint8_t *previous_string = nullptr;
+		size_t previous_string_length = 0;
+
+		for (size_t row_number = 0; row_number < rows_used; row_number++) {
+			PackedValueView value(rows[row_number][column_number]);
+			if (value.is_nil()) continue;
+
+			if (integers) {
+				packed_integer(value, integer_value);
+				uint64_t difference = (uint64_t)integer_value - previous_integer; // wraps around rather than overflowing
+				append_varint(chunk, (difference << 1) ^ (uint64_t)((int64_t)difference >> 63));
+				previous_integer = integer_value;
+
+			} else if (strings) {
+				value.raw_bytes(string_data, string_length);
+				size_t shared = 0;
+				while (shared < string_length && shared < previous_string_length && string_data[shared] == previous_string[shared]) shared++;
+				append_varint(chunk, shared);
+				append_varint(chunk, string_length - shared);
+				chunk.write(string_data + shared, string_length - shared);
+				previous_string = string_data;
+				previous_string_length = string_length;
+
+			} else {
+				append_varint(chunk, value.size());
+				chunk.write(value.data(), value.size());
+			}
+		}
+	}
+
+	Packer<OutputStream> &packer;
+	vector<FlatRow> rows;
+	size_t rows_used;
+	size_t bytes_used;
+	PackedValue chunk;
+};
+
+template <typename OutputStream, typename T>
+inline ColumnarBatchPacker<OutputStream> &operator <<(ColumnarBatchPacker<OutputStream> &packer, const T &obj) {
+	packer.current_row() << obj;
+	return packer;
+}
+
+template <typename OutputStream>
+inline void pack_array_length(ColumnarBatchPacker<OutputStream> &packer, size_t size) {
+	packer.start_row(size);
+}
+
+struct ColumnChunkReader {
+	ColumnChunkReader(const string &chunk): pos((const uint8_t *)chunk.data()), end((const uint8_t *)chunk.data() + chunk.size()) {}
+
+	inline const uint8_t *bytes(size_t length) {
+		if (length > (size_t)(end - pos)) throw command_error("Column chunk is truncated");
+		const uint8_t *result = pos;
+		pos += length;
+		return result;
+	}
+
+	inline uint64_t varint() {
+		uint64_t result = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte = *bytes(1);
+			result |= (uint64_t)(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return result;
+		}
+		throw command_error("Column chunk has an invalid varint");
+	}
+
+	const uint8_t *pos;
+	const uint8_t *end;
+};
+
+// turns the batches back into FlatRows, decoding a whole batch a column at a time and then handing out its rows
+struct ColumnarBatchDecoder {
+	ColumnarBatchDecoder(): rows_used(0), next_row(0) {}
+
+	// called at the start of each response
+	void clear() {
+		rows_used = next_row = 0;
+	}
+
+	template <typename InputStream>
+	void read_row(Unpacker<InputStream> &unpacker, FlatRow &row) {
+		if (next_row == rows_used) read_batch(unpacker);
+
+		if (next_row == rows_used) {
+			row.clear(); // we've reached the empty array that ends the response
+		} else {
+			swap(row, rows[next_row++]); // gives us back the caller's buffers to reuse
+		}
+	}
+
+	template <typename InputStream>
+	void read_batch(Unpacker<InputStream> &unpacker) {
+		rows_used = next_row = 0;
+
+		size_t length = unpacker.next_array_length();
+		if (!length) return;
+
+		size_t row_count = unpacker.template next<size_t>();
+		if (!row_count || row_count > MAX_COLUMNAR_BATCH_ROWS) throw command_error("Invalid columnar batch size " + to_string(row_count));
+		if (rows.size() < row_count) rows.resize(row_count);
+		for (size_t row_number = 0; row_number < row_count; row_number++) {
+			rows[row_number].clear();
+			rows[row_number].reserve(length - 1);
+		}
+
+		for (size_t column_number = 0; column_number < length - 1; column_number++) {
+			unpacker >> chunk;
+			decode_column(row_count);
+		}
+		rows_used = row_count;
+	}
+
+	void decode_column(size_t row_count) {
+		ColumnChunkReader reader(chunk);
+		uint8_t encoding = *reader.bytes(1);
+		if (encoding > string_column) throw command_error("Unknown column chunk encoding " + to_string((int)encoding));
+		const uint8_t *nulls = reader.bytes((row_count + 7)/8);
+
+		uint64_t previous_integer = 0;
+		previous_string.clear();
+
+		for (size_t row_number = 0; row_number < row_count; row_number++) {
+			FlatRow &row(rows[row_number]);
+			row.start_column();
+
+			if (nulls[row_number/8] & (1 << (row_number % 8))) {
+				row.encoded << nullptr;
+
+			} else if (encoding == integer_column) {
+				uint64_t zigzag = reader.varint();
+				previous_integer += (zigzag >> 1) ^ -(zigzag & 1);
+				row.encoded << (long long)(int64_t)previous_integer;
+
+			} else if (encoding == string_column) {
+				size_t shared = reader.varint();
+				if (shared > previous_string.size()) throw command_error("Column chunk has an invalid string prefix length");
+				size_t suffix_length = reader.varint();
+				previous_string.resize(shared);
+				previous_string.append((const char *)reader.bytes(suffix_length), suffix_length);
+				row.encoded << memory(previous_string.data(), previous_string.size());
+
+			} else {
+				size_t value_length = reader.varint();
+				row.encoded.write(reader.bytes(value_length), value_length);
+			}
+		}
+	}
+
+	vector<FlatRow> rows;
+	size_t rows_used;
+	size_t next_row;
+	string chunk;
+	string previous_string;
+};
+
+#endif
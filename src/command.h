@@ -18,21 +18,22 @@ inline void read_values(Unpacker<InputStream> &unpacker) {
 	/* do nothing, this specialization is just to terminate the variadic template expansion */
 }
 
+// the arguments are taken as universal references so that wrappers such as KeyCache::KeyToReceive can be passed as temporaries
 template <typename InputStream, typename T, typename... Values>
-inline void read_values(Unpacker<InputStream> &unpacker, T &arg0, Values &...args) {
+inline void read_values(Unpacker<InputStream> &unpacker, T &&arg0, Values &&...args) {
 	unpacker >> arg0;
 	read_values(unpacker, args...);
 }
 
 template <typename InputStream, typename... Values>
-inline void read_array(Unpacker<InputStream> &unpacker, Values &...args) {
+inline void read_array(Unpacker<InputStream> &unpacker, Values &&...args) {
 	size_t array_length = unpacker.next_array_length(); // checks type
 	if (array_length != sizeof...(args)) throw command_error("Expected " + to_string(sizeof...(args)) + " arguments, got " + to_string(array_length));
 	read_values(unpacker, args...);
 }
 
 template <typename InputStream, typename... Values>
-inline void read_all_arguments(Unpacker<InputStream> &unpacker, Values &...args) {
+inline void read_all_arguments(Unpacker<InputStream> &unpacker, Values &&...args) {
 	read_array(unpacker, args...);
 	if (sizeof...(Values) > 0) { // in which case read_array has already checked we received the empty array to indicate no more arguments
 		size_t array_length = unpacker.next_array_length(); // checks type
@@ -104,6 +105,9 @@ namespace Commands {
 	const verb_t SCHEMA = 37;
 	const verb_t TARGET_BLOCK_SIZE = 38;
 	const verb_t HASH_ALGORITHM = 39;
+	const verb_t KEY_CACHE_SIZE = 40;
+	const verb_t PING = 41;
+	const verb_t ROWS_ENCODING = 42;
 	const verb_t QUIT = 0;
 };
 
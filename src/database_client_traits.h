@@ -19,4 +19,13 @@ struct SetNullability {
 struct SupportsAddNonNullableColumns {
 };
 
+struct SupportsCopy {
+};
+
+struct SupportsUpsert {
+};
+
+struct SupportsPipelining {
+};
+
 #endif
@@ -1,57 +1,195 @@
 #ifndef ENCODE_PACKED
 #define ENCODE_PACKED
 
+#include <vector>
+#include "schema.h"
 #include "message_pack/copy_packed.h"
 
-template <typename DatabaseClient>
-string encode(DatabaseClient &client, const Column &column, const PackedValue &value) {
-	if (value.is_nil())		return "NULL";
-	if (value.is_false())	return "false";
-	if (value.is_true())	return "true";
+// appends the decimal digits of value to result without making a temporary string
+template <typename T>
+inline void append_integer(string &result, T value) {
+	char digits[24];
+	char *end = digits + sizeof(digits), *start = end;
+	bool negative = (value < 0);
+	do {
+		int digit = value % 10;
+		*--start = '0' + (negative ? -digit : digit);
+		value /= 10;
+	} while (value);
+	if (negative) *--start = '-';
+	result.append(start, end - start);
+}
 
-	VectorReadStream stream(value);
-	Unpacker<VectorReadStream> unpacker(stream);
+// appends the SQL literal for value to result, escaping strings straight into it
+template <typename DatabaseClient>
+void append_encoded(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
 	uint8_t leader = value.leader();
 
-	if ((leader >= MSGPACK_POSITIVE_FIXNUM_MIN && leader <= MSGPACK_POSITIVE_FIXNUM_MAX) ||
-		(leader >= MSGPACK_NEGATIVE_FIXNUM_MIN && leader <= MSGPACK_NEGATIVE_FIXNUM_MAX)) {
-		return to_string((int)unpacker.template next<int8_t>()); // up-cast to avoid int8_t being interpreted as char
+	if (leader <= MSGPACK_POSITIVE_FIXNUM_MAX) {
+		append_integer(result, (int)leader);
+		return;
+	}
+	if (leader >= MSGPACK_NEGATIVE_FIXNUM_MIN) {
+		append_integer(result, (int)(int8_t)leader);
+		return;
+	}
+
+	const uint8_t *string_data;
+	size_t string_length;
+	if (value.raw_bytes(string_data, string_length)) {
+		result += '\'';
+		client.append_escaped_column_value_to(result, column, string_data, string_length);
+		result += '\'';
+		return;
 	}
 
+	VectorReadStream stream(value);
+	Unpacker<VectorReadStream> unpacker(stream);
+
 	switch (leader) {
-		case MSGPACK_FLOAT:
-			return to_string(unpacker.template next<float>());
+		case MSGPACK_NIL:
+			result += "NULL";
+			break;
 
-		case MSGPACK_DOUBLE:
-			return to_string(unpacker.template next<double>());
+		case MSGPACK_FALSE:
+			result += "false";
+			break;
 
-		case MSGPACK_UINT8:
-			return to_string((unsigned int)unpacker.template next<uint8_t>()); // up-cast as above
+		case MSGPACK_TRUE:
+			result += "true";
+			break;
 
-		case MSGPACK_UINT16:
-			return to_string(unpacker.template next<uint16_t>());
+		case MSGPACK_FLOAT:
+			result += to_string(unpacker.template next<float>());
+			break;
 
-		case MSGPACK_UINT32:
-			return to_string(unpacker.template next<uint32_t>());
+		case MSGPACK_DOUBLE:
+			result += to_string(unpacker.template next<double>());
+			break;
 
 		case MSGPACK_UINT64:
-			return to_string(unpacker.template next<uint64_t>());
+			append_integer(result, unpacker.template next<uint64_t>());
+			break;
 
+		case MSGPACK_UINT8:
+		case MSGPACK_UINT16:
+		case MSGPACK_UINT32:
 		case MSGPACK_INT8:
-			return to_string((int)unpacker.template next<int8_t>()); // up-cast as above
-
 		case MSGPACK_INT16:
-			return to_string(unpacker.template next<int16_t>());
-
 		case MSGPACK_INT32:
-			return to_string(unpacker.template next<int32_t>());
-
 		case MSGPACK_INT64:
-			return to_string(unpacker.template next<int64_t>());
+			append_integer(result, unpacker.template next<int64_t>());
+			break;
 
 		default:
-			return "'" + client.escape_column_value(column, unpacker.template next<string>()) + "'";
+			throw unpacker_error("Don't know how to convert MessagePack type " + to_string((int)leader) + " to SQL");
 	}
 }
 
+template <typename DatabaseClient>
+inline string encode(DatabaseClient &client, const Column &column, const PackedValueView &value) {
+	string result;
+	append_encoded(client, column, value, result);
+	return result;
+}
+
+// appends value to result in the text format used by COPY, which has no quoting and a special marker for NULL
+template <typename DatabaseClient>
+void append_copy_encoded(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
+	const uint8_t *string_data;
+	size_t string_length;
+	if (value.raw_bytes(string_data, string_length)) {
+		client.append_copy_escaped_column_value_to(result, column, string_data, string_length);
+	} else if (value.is_nil()) {
+		result += "\\N";
+	} else if (value.is_false()) {
+		result += 'f';
+	} else if (value.is_true()) {
+		result += 't';
+	} else {
+		append_encoded(client, column, value, result); // numbers are written the same way as in SQL
+	}
+}
+
+// encoding each value with append_encoded() above means working out what to do from scratch for every value,
+// which adds up on wide tables.  instead, when we set up to apply changes to a table we choose an encoding
+// function for each column from its type, which handles the values that column normally has directly, and only
+// falls back to the general append_encoded() for anything else (such as a NULL in a string column).
+template <typename DatabaseClient>
+struct ColumnEncoders {
+	typedef void (*Function)(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result);
+
+	static void append_integer_value(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
+		uint8_t leader = value.leader();
+
+		if (leader <= MSGPACK_POSITIVE_FIXNUM_MAX) {
+			append_integer(result, (int)leader);
+		} else if (leader >= MSGPACK_NEGATIVE_FIXNUM_MIN) {
+			append_integer(result, (int)(int8_t)leader);
+		} else if (leader == MSGPACK_UINT64) {
+			VectorReadStream stream(value);
+			Unpacker<VectorReadStream> unpacker(stream);
+			append_integer(result, unpacker.template next<uint64_t>());
+		} else if (leader >= MSGPACK_UINT8 && leader <= MSGPACK_INT64) {
+			VectorReadStream stream(value);
+			Unpacker<VectorReadStream> unpacker(stream);
+			append_integer(result, unpacker.template next<int64_t>());
+		} else {
+			append_encoded(client, column, value, result);
+		}
+	}
+
+	static void append_boolean_value(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
+		if (value.is_false()) {
+			result += "false";
+		} else if (value.is_true()) {
+			result += "true";
+		} else {
+			append_encoded(client, column, value, result);
+		}
+	}
+
+	static void append_string_value(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
+		const uint8_t *string_data;
+		size_t string_length;
+		if (value.raw_bytes(string_data, string_length)) {
+			result += '\'';
+			client.append_escaped_column_value_to(result, column, string_data, string_length);
+			result += '\'';
+		} else {
+			append_encoded(client, column, value, result);
+		}
+	}
+
+	static void append_value(DatabaseClient &client, const Column &column, const PackedValueView &value, string &result) {
+		append_encoded(client, column, value, result);
+	}
+
+	static Function for_column(const Column &column) {
+		if (column.column_type == ColumnTypes::SINT || column.column_type == ColumnTypes::UINT) {
+			return &append_integer_value;
+		} else if (column.column_type == ColumnTypes::BOOL) {
+			return &append_boolean_value;
+		} else if (column.column_type == ColumnTypes::BLOB || column.column_type == ColumnTypes::TEXT ||
+				   column.column_type == ColumnTypes::VCHR || column.column_type == ColumnTypes::FCHR) {
+			return &append_string_value;
+		} else {
+			return &append_value;
+		}
+	}
+
+	ColumnEncoders(const Columns &columns) {
+		functions.reserve(columns.size());
+		for (const Column &column : columns) {
+			functions.push_back(for_column(column));
+		}
+	}
+
+	inline void append(DatabaseClient &client, const Columns &columns, size_t column_number, const PackedValueView &value, string &result) const {
+		functions[column_number](client, columns[column_number], value, result);
+	}
+
+	std::vector<Function> functions;
+};
+
 #endif
@@ -72,9 +72,11 @@ int endpoint_main(int argc, char *argv[]) {
 			bool alter = getenv_default("ENDPOINT_ALTER", true);
 			CommitLevel commit_level = CommitLevel(getenv_default("ENDPOINT_COMMIT_LEVEL", CommitLevel::success));
 			HashAlgorithm hash_algorithm = HashAlgorithm(getenv_default("ENDPOINT_HASH_ALGORITHM", HashAlgorithm::md5));
+			RowsEncoding rows_encoding = RowsEncoding(getenv_default("ENDPOINT_ROWS_ENCODING", RowsEncoding::dictionary));
 			bool structure_only = getenv_default("ENDPOINT_STRUCTURE_ONLY", false);
+			bool fast_apply = getenv_default("ENDPOINT_FAST_APPLY", false);
 
-			sync_to<DatabaseClient>(workers, startfd, database_host, database_port, database_name, database_username, database_password, set_variables, ignore, only, verbose, progress, snapshot, alter, commit_level, hash_algorithm, structure_only);
+			sync_to<DatabaseClient>(workers, startfd, database_host, database_port, database_name, database_username, database_password, set_variables, ignore, only, verbose, progress, snapshot, alter, commit_level, hash_algorithm, rows_encoding, structure_only, fast_apply);
 		}
 	} catch (const sync_error& e) {
 		// the worker thread has already output the error to cerr
@@ -2,7 +2,13 @@
 #define FDSTREAM_H
 
 #include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdexcept>
+#include <chrono>
+#include <memory>
+#include "shared_memory_ring.h"
 
 struct stream_error: public std::runtime_error {
 	stream_error(const std::string &error): runtime_error(error) {}
@@ -12,14 +18,125 @@ struct stream_closed_error: public stream_error {
 	stream_closed_error(): stream_error("Connection closed") {}
 };
 
+const std::chrono::milliseconds CORKED_FLUSH_DELAY(5);
+
+struct FDWriteStream {
+	static const size_t CORKED_FLUSH_BYTES = 8192;
+
+	FDWriteStream(int fd): fd(fd), buf_used(0), corked(false), deferred(false) {
+		if (SharedMemoryRing::is_ring(fd)) ring.reset(new SharedMemoryRing(fd));
+	}
+
+	~FDWriteStream() {
+		close();
+	}
+
+	void close() {
+		if (ring) {
+			ring->close_write();
+			ring.reset();
+		}
+		if (fd) {
+			::close(fd);
+			fd = 0;
+		}
+	}
+
+	// switches to coalescing mode: after this, flush() only writes out the buffer once enough has accumulated or
+	// it has been waiting for a while, so that small commands sent in quick succession go out in one write.  the
+	// caller becomes responsible for calling force_flush() whenever it's about to wait for the other end to reply;
+	// FDReadStream and ReadAheadStream can do that automatically, see flush_when_blocking.
+	void cork() {
+		corked = true;
+
+		// since we now do our own coalescing, there's no point also having the kernel delay small packets if we
+		// happen to be talking over a TCP socket; this just fails with ENOTSOCK for pipes, which we can ignore.
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+
+	// writes the given number of bytes as-is to the data stream, possibly using a buffer; call flush() to force that to the underlying descriptor
+	inline void write(const uint8_t *src, size_t bytes) {
+		if (bytes > sizeof(buf)) { // this both protects against integer overflows and avoids unnecessary copying into our buffer for large objects
+			force_flush();
+			write_buf(src, bytes);
+
+		} else if (buf_used + bytes > sizeof(buf)) {
+			force_flush();
+			memcpy(buf, src, bytes);
+			buf_used = bytes;
+
+		} else {
+			memcpy(buf + buf_used, src, bytes);
+			buf_used += bytes;
+		}
+	}
+
+	// forces any bytes currently in the buffer to the underlying descriptor, unless we've been corked, in which
+	// case that only happens if enough bytes have been buffered or the first call to flush() was a while ago
+	inline void flush() {
+		if (!corked || buf_used >= CORKED_FLUSH_BYTES) {
+			force_flush();
+		} else if (!deferred) {
+			deferred = true;
+			deferred_since = std::chrono::steady_clock::now();
+		} else if (std::chrono::steady_clock::now() - deferred_since >= CORKED_FLUSH_DELAY) {
+			force_flush();
+		}
+	}
+
+	// forces any bytes currently in the buffer to the underlying descriptor, even if we've been corked
+	inline void force_flush() {
+		write_buf(buf, buf_used);
+		buf_used = 0;
+		deferred = false;
+	}
+
+	inline bool have_buffered_bytes() const {
+		return (buf_used > 0);
+	}
+
+protected:
+	void write_buf(const uint8_t* ptr, size_t bytes) {
+		if (ring) {
+			if (!ring->write(ptr, bytes)) throw stream_error("Couldn't write to descriptor: " + string(strerror(EPIPE)));
+			return;
+		}
+		ssize_t bytes_written;
+		while (bytes > 0) {
+			bytes_written = ::write(fd, ptr, bytes);
+			if (bytes_written <= 0) {
+				if (errno == EINTR) continue;
+				throw stream_error("Couldn't write to descriptor: " + string(strerror(errno)));
+			}
+			ptr   += bytes_written;
+			bytes -= bytes_written;
+		}
+	}
+
+	int fd;
+	size_t buf_used;
+	bool corked;
+	bool deferred;
+	std::chrono::steady_clock::time_point deferred_since;
+	std::unique_ptr<SharedMemoryRing> ring;
+	uint8_t buf[16384];
+};
+
 struct FDReadStream {
-	FDReadStream(int fd): fd(fd), buf_pos(0), buf_avail(0) {}
+	FDReadStream(int fd): fd(fd), buf_pos(0), buf_avail(0), flush_before_reading(nullptr) {
+		if (SharedMemoryRing::is_ring(fd)) ring.reset(new SharedMemoryRing(fd));
+	}
 
 	~FDReadStream() {
 		close();
 	}
 
 	void close() {
+		if (ring) {
+			ring->close_read();
+			ring.reset();
+		}
 		if (fd) {
 			::close(fd);
 			fd = 0;
@@ -39,6 +156,20 @@ struct FDReadStream {
 		buf_avail -= bytes;
 	}
 
+	// makes us force_flush() the given output stream before we read from our descriptor, since we may have to wait
+	// for the other end to send us something, which it may not do until it has received what we've buffered up
+	void flush_when_blocking(FDWriteStream &output) {
+		flush_before_reading = &output;
+	}
+
+	// returns the bytes already in our buffer, which may be consumed using skip(); reads from the descriptor
+	// first if the buffer is empty, so should only be used when about to read
+	inline const uint8_t *peek(size_t &bytes_available) {
+		if (!buf_avail) populate_buf();
+		bytes_available = buf_avail;
+		return buf + buf_pos;
+	}
+
 	inline void skip(size_t bytes) {
 		while (bytes > buf_avail) {
 			bytes -= buf_avail;
@@ -55,6 +186,15 @@ protected:
 	void populate_buf() {
 		ssize_t bytes_read;
 		buf_pos = 0;
+		buf_avail = 0;
+		if (flush_before_reading && flush_before_reading->have_buffered_bytes()) {
+			flush_before_reading->force_flush();
+		}
+		if (ring) {
+			buf_avail = ring->read(buf, sizeof(buf));
+			if (!buf_avail) throw stream_closed_error();
+			return;
+		}
 		while (true) {
 			bytes_read = ::read(fd, buf, sizeof(buf));
 			if (bytes_read == 0) {
@@ -73,62 +213,8 @@ protected:
 
 	int fd;
 	size_t buf_pos, buf_avail;
-	uint8_t buf[16384];
-};
-
-struct FDWriteStream {
-	FDWriteStream(int fd): fd(fd), buf_used(0) {}
-	
-	~FDWriteStream() {
-		close();
-	}
-
-	void close() {
-		if (fd) {
-			::close(fd);
-			fd = 0;
-		}
-	}
-
-	// writes the given number of bytes as-is to the data stream, possibly using a buffer; call flush() to force that to the underlying descriptor
-	inline void write(const uint8_t *src, size_t bytes) {
-		if (bytes > sizeof(buf)) { // this both protects against integer overflows and avoids unnecessary copying into our buffer for large objects
-			flush();
-			write_buf(src, bytes);
-
-		} else if (buf_used + bytes > sizeof(buf)) {
-			flush();
-			memcpy(buf, src, bytes);
-			buf_used = bytes;
-
-		} else {
-			memcpy(buf + buf_used, src, bytes);
-			buf_used += bytes;
-		}
-	}
-
-	// forces any bytes currently in the buffer to the underlying descriptor
-	inline void flush() {
-		write_buf(buf, buf_used);
-		buf_used = 0;
-	}
-
-protected:
-	void write_buf(const uint8_t* ptr, size_t bytes) {
-		ssize_t bytes_written;
-		while (bytes > 0) {
-			bytes_written = ::write(fd, ptr, bytes);
-			if (bytes_written <= 0) {
-				if (errno == EINTR) continue;
-				throw stream_error("Couldn't write to descriptor: " + string(strerror(errno)));
-			}
-			ptr   += bytes_written;
-			bytes -= bytes_written;
-		}
-	}
-
-	int fd;
-	size_t buf_used;
+	FDWriteStream *flush_before_reading;
+	std::unique_ptr<SharedMemoryRing> ring;
 	uint8_t buf[16384];
 };
 
@@ -0,0 +1,101 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+#include "command.h"
+#include "schema.h"
+#include "message_pack/copy_packed.h"
+
+const size_t DEFAULT_KEY_CACHE_SIZE = 8;
+const size_t MAX_KEY_CACHE_SIZE = 127; // so that references always fit in a single byte
+
+// most range commands repeat keys that were sent in the previous command (in either direction), and for wide
+// or string primary keys those are much bigger than the hash, so from protocol version 7 both ends remember
+// the last few keys sent in full for the current table, and send a key that's already in the cache as its
+// position in the cache rather than its values.  this works because both ends see the keys in the same order -
+// each end only sends commands in response to commands that it has completely read - so as long as both ends
+// remember every non-empty key sent in full, whichever direction it was sent in, their caches stay identical.
+struct KeyCache {
+	KeyCache(): next(0) {}
+
+	// the size is agreed between the two ends; a size of 0 disables the cache (the default)
+	void resize(size_t size) {
+		keys.clear();
+		keys.resize(size);
+		next = 0;
+	}
+
+	// called when a new table is opened
+	void clear() {
+		for (ColumnValues &key : keys) key.clear();
+		next = 0;
+	}
+
+	inline int find(const ColumnValues &key) const {
+		if (key.empty()) return -1; // always cheaper to send in full
+		for (size_t index = 0; index < keys.size(); index++) {
+			if (keys[index] == key) return index;
+		}
+		return -1;
+	}
+
+	inline void remember(const ColumnValues &key) {
+		if (keys.empty() || key.empty()) return;
+		keys[next] = key;
+		next = (next + 1) % keys.size();
+	}
+
+	inline const ColumnValues &at(size_t index) const {
+		if (index >= keys.size() || keys[index].empty()) throw command_error("Invalid key cache reference " + to_string(index));
+		return keys[index];
+	}
+
+	struct KeyToSend {
+		KeyCache &cache;
+		const ColumnValues &key;
+	};
+
+	struct KeyToReceive {
+		KeyCache &cache;
+		ColumnValues &key;
+	};
+
+	// wrap keys in these when passing them to send_command or read_all_arguments to use the cache
+	inline KeyToSend sending(const ColumnValues &key) { return KeyToSend{*this, key}; }
+	inline KeyToReceive receiving(ColumnValues &key) { return KeyToReceive{*this, key}; }
+
+	vector<ColumnValues> keys;
+	size_t next;
+};
+
+template <typename OutputStream>
+Packer<OutputStream> &operator <<(Packer<OutputStream> &packer, const KeyCache::KeyToSend &key_to_send) {
+	int index = key_to_send.cache.find(key_to_send.key);
+	if (index >= 0) {
+		packer << index;
+	} else {
+		packer << key_to_send.key;
+		key_to_send.cache.remember(key_to_send.key);
+	}
+	return packer;
+}
+
+template <typename InputStream>
+Unpacker<InputStream> &operator >>(Unpacker<InputStream> &unpacker, KeyCache::KeyToReceive &key_to_receive) {
+	PackedValue value;
+	unpacker >> value;
+
+	uint8_t leader = value.leader();
+	if ((leader >= MSGPACK_POSITIVE_FIXNUM_MIN && leader <= MSGPACK_POSITIVE_FIXNUM_MAX) || leader == MSGPACK_UINT8) {
+		VectorReadStream stream(value);
+		Unpacker<VectorReadStream> value_unpacker(stream);
+		key_to_receive.key = key_to_receive.cache.at(value_unpacker.template next<size_t>());
+	} else {
+		VectorReadStream stream(value);
+		Unpacker<VectorReadStream> value_unpacker(stream);
+		value_unpacker >> key_to_receive.key;
+		key_to_receive.cache.remember(key_to_receive.key);
+	}
+	return unpacker;
+}
+
+#endif
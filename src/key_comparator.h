@@ -0,0 +1,290 @@
+#ifndef KEY_COMPARATOR_H
+#define KEY_COMPARATOR_H
+
+#include <cmath>
+#include <cstdlib>
+#include "schema.h"
+#include "message_pack/flat_row.h"
+
+// true for integers too big to fit in an int64_t, which msgpack encodes as uint64s
+inline bool packed_integer_exceeds_int64(const PackedValueView &value) {
+	if (value.leader() != MSGPACK_UINT64) return false;
+	VectorReadStream stream(value);
+	Unpacker<VectorReadStream> unpacker(stream);
+	return (unpacker.template next<uint64_t>() > (uint64_t)INT64_MAX);
+}
+
+// compares packed integer (or boolean) values numerically, which is how the database orders them
+inline int compare_packed_integers(const PackedValueView &a, const PackedValueView &b) {
+	bool a_exceeds_int64 = packed_integer_exceeds_int64(a);
+	bool b_exceeds_int64 = packed_integer_exceeds_int64(b);
+
+	if (a_exceeds_int64 || b_exceeds_int64) {
+		if (!b_exceeds_int64) return 1;
+		if (!a_exceeds_int64) return -1;
+		VectorReadStream a_stream(a), b_stream(b);
+		Unpacker<VectorReadStream> a_unpacker(a_stream), b_unpacker(b_stream);
+		uint64_t a_value = a_unpacker.template next<uint64_t>(), b_value = b_unpacker.template next<uint64_t>();
+		return (a_value < b_value ? -1 : a_value > b_value ? 1 : 0);
+	}
+
+	VectorReadStream a_stream(a), b_stream(b);
+	Unpacker<VectorReadStream> a_unpacker(a_stream), b_unpacker(b_stream);
+	int64_t a_value = a_unpacker.template next<int64_t>(), b_value = b_unpacker.template next<int64_t>();
+	return (a_value < b_value ? -1 : a_value > b_value ? 1 : 0);
+}
+
+// the database clients return floating point values as text, but they may also be packed as floats or doubles
+inline double packed_real(const PackedValueView &value) {
+	const uint8_t *data;
+	size_t length;
+	if (value.raw_bytes(data, length)) {
+		char text[64];
+		if (length < sizeof(text)) {
+			memcpy(text, data, length);
+			text[length] = 0;
+			return strtod(text, nullptr);
+		}
+		return strtod(string((const char *)data, length).c_str(), nullptr);
+	}
+
+	VectorReadStream stream(value);
+	Unpacker<VectorReadStream> unpacker(stream);
+	return unpacker.template next<double>();
+}
+
+// compares packed floating point values numerically; PostgreSQL sorts NaN after all other values
+inline int compare_packed_reals(const PackedValueView &a, const PackedValueView &b) {
+	double a_value = packed_real(a), b_value = packed_real(b);
+	if (std::isnan(a_value)) return (std::isnan(b_value) ? 0 : 1);
+	if (std::isnan(b_value)) return -1;
+	return (a_value < b_value ? -1 : a_value > b_value ? 1 : 0);
+}
+
+// decimal values are returned as text, and may have more digits than we can convert to a number without losing
+// precision, so we compare them by their digits.  PostgreSQL also has NaN and (since 14) infinite decimal values;
+// it sorts -Infinity before and Infinity after all finite values, and NaN after everything.
+struct DecimalDigits {
+	DecimalDigits(const PackedValueView &value): negative(false), nan(false), infinite(0), integer_length(0), fraction_length(0) {
+		const uint8_t *data;
+		size_t length;
+		if (!value.raw_bytes(data, length)) throw runtime_error("Expected a decimal value in text form");
+
+		const char *pos = (const char *)data, *end = pos + length;
+		if (length == 3 && memcmp(pos, "NaN", 3) == 0) {
+			nan = true;
+			return;
+		}
+
+		if (pos != end && (*pos == '-' || *pos == '+')) negative = (*pos++ == '-');
+		if (end - pos == 8 && memcmp(pos, "Infinity", 8) == 0) {
+			infinite = (negative ? -1 : 1);
+			return;
+		}
+		while (pos != end && *pos == '0') pos++; // leading zeros don't change the value
+		integer = pos;
+		while (pos != end && *pos != '.') pos++;
+		integer_length = pos - integer;
+		if (pos != end) pos++;
+		fraction = pos;
+		fraction_length = end - pos;
+		while (fraction_length && fraction[fraction_length - 1] == '0') fraction_length--; // nor do trailing zeros
+		if (!integer_length && !fraction_length) negative = false; // -0 is 0
+	}
+
+	inline bool zero() const { return (!integer_length && !fraction_length); }
+
+	int compare_magnitude(const DecimalDigits &other) const {
+		if (integer_length != other.integer_length) return (integer_length < other.integer_length ? -1 : 1);
+		int result = memcmp(integer, other.integer, integer_length);
+		if (result) return result;
+		result = memcmp(fraction, other.fraction, min(fraction_length, other.fraction_length));
+		if (result) return result;
+		return (fraction_length < other.fraction_length ? -1 : fraction_length > other.fraction_length ? 1 : 0);
+	}
+
+	bool negative;
+	bool nan;
+	int infinite; // -1 for -Infinity, 1 for Infinity
+	const char *integer;
+	size_t integer_length;
+	const char *fraction;
+	size_t fraction_length;
+};
+
+inline int compare_packed_decimals(const PackedValueView &a, const PackedValueView &b) {
+	DecimalDigits a_digits(a), b_digits(b);
+	if (a_digits.nan) return (b_digits.nan ? 0 : 1);
+	if (b_digits.nan) return -1;
+	if (a_digits.infinite || b_digits.infinite) return (a_digits.infinite < b_digits.infinite ? -1 : a_digits.infinite > b_digits.infinite ? 1 : 0);
+	if (a_digits.negative != b_digits.negative) return (a_digits.negative ? -1 : 1);
+	int result = a_digits.compare_magnitude(b_digits);
+	return (a_digits.negative ? -result : result);
+}
+
+// binary strings are ordered bytewise by both databases, with a string sorting before any longer string it is
+// a prefix of.  other strings are ordered by their collation, which we don't know, so aren't supported.
+inline int compare_packed_binaries(const PackedValueView &a, const PackedValueView &b) {
+	const uint8_t *a_data, *b_data;
+	size_t a_length, b_length;
+	if (!a.raw_bytes(a_data, a_length) || !b.raw_bytes(b_data, b_length)) throw runtime_error("Expected a binary string value");
+	int result = memcmp(a_data, b_data, min(a_length, b_length));
+	if (result) return result;
+	return (a_length < b_length ? -1 : a_length > b_length ? 1 : 0);
+}
+
+// the normalized key encoding turns a row's key into a string of bytes that sort with memcmp in the same order
+// as the key values themselves, so that keys can be compared, hashed, and kept in sorted containers without
+// decoding them again.  each value's encoding is self-delimiting, so the column values can simply be appended.
+inline void append_big_endian(string &result, uint64_t value) {
+	for (int shift = 56; shift >= 0; shift -= 8) {
+		result += (char)(uint8_t)(value >> shift);
+	}
+}
+
+inline void append_normalized_integer(string &result, const PackedValueView &value) {
+	// a tag byte separating integers that don't fit in an int64_t from those that do, then the value in 8 bytes
+	VectorReadStream stream(value);
+	Unpacker<VectorReadStream> unpacker(stream);
+	if (packed_integer_exceeds_int64(value)) {
+		result += '\x01';
+		append_big_endian(result, unpacker.template next<uint64_t>());
+	} else {
+		result += '\x00';
+		append_big_endian(result, (uint64_t)unpacker.template next<int64_t>() ^ 0x8000000000000000ULL); // flip the sign bit so negatives sort first
+	}
+}
+
+inline void append_normalized_real(string &result, const PackedValueView &value) {
+	double real = packed_real(value);
+	uint64_t bits;
+	if (std::isnan(real)) {
+		bits = UINT64_MAX; // after everything else, including infinity
+	} else {
+		if (real == 0) real = 0; // -0 is 0
+		memcpy(&bits, &real, sizeof(bits));
+		bits = ((bits & 0x8000000000000000ULL) ? ~bits : bits | 0x8000000000000000ULL);
+	}
+	append_big_endian(result, bits);
+}
+
+inline void append_normalized_decimal(string &result, const PackedValueView &value) {
+	// a tag byte for -Infinity, negative, zero, positive, Infinity, or NaN; then for finite non-zero values, the
+	// number of integer digits, which orders values of different magnitudes; then the digits, ended by a byte that
+	// sorts before any digit.  for negative values all but the tag byte are inverted, so larger magnitudes sort first.
+	DecimalDigits digits(value);
+	if (digits.nan) {
+		result += '\x05';
+		return;
+	}
+	if (digits.infinite) {
+		result += (digits.infinite < 0 ? '\x00' : '\x04');
+		return;
+	}
+	if (digits.zero()) {
+		result += '\x02';
+		return;
+	}
+
+	uint8_t invert = (digits.negative ? 0xff : 0x00);
+	result += (digits.negative ? '\x01' : '\x03');
+	append_big_endian(result, digits.integer_length ^ (digits.negative ? UINT64_MAX : 0));
+	for (size_t n = 0; n < digits.integer_length; n++) result += (char)(digits.integer[n] ^ invert);
+	for (size_t n = 0; n < digits.fraction_length; n++) result += (char)(digits.fraction[n] ^ invert);
+	result += (char)invert;
+}
+
+inline void append_normalized_binary(string &result, const PackedValueView &value) {
+	// 0 bytes are escaped as 0, 255 so that the string can be ended by 0, 0, which sorts before any other byte
+	const uint8_t *data;
+	size_t length;
+	if (!value.raw_bytes(data, length)) throw runtime_error("Expected a binary string value");
+	for (const uint8_t *end = data + length; data != end; data++) {
+		result += (char)*data;
+		if (!*data) result += '\xff';
+	}
+	result += '\x00';
+	result += '\x00';
+}
+
+// orders rows by their primary key values in the same way as the database's ORDER BY does, for those tables whose
+// primary key columns have types we know the ordering of; for most string types that would depend on the
+// collation, so only binary strings are supported.
+struct KeyComparator {
+	typedef int (*CompareFunction)(const PackedValueView &a, const PackedValueView &b);
+	typedef void (*NormalizeFunction)(string &result, const PackedValueView &value);
+
+	KeyComparator(const Table &table): primary_key_columns(table.primary_key_columns) {
+		for (size_t column_number : primary_key_columns) {
+			const string &column_type(table.columns[column_number].column_type);
+			if (column_type == ColumnTypes::REAL) {
+				compare_functions.push_back(&compare_packed_reals);
+				normalize_functions.push_back(&append_normalized_real);
+			} else if (column_type == ColumnTypes::DECI) {
+				compare_functions.push_back(&compare_packed_decimals);
+				normalize_functions.push_back(&append_normalized_decimal);
+			} else if (column_type == ColumnTypes::BLOB) {
+				compare_functions.push_back(&compare_packed_binaries);
+				normalize_functions.push_back(&append_normalized_binary);
+			} else {
+				compare_functions.push_back(&compare_packed_integers);
+				normalize_functions.push_back(&append_normalized_integer);
+			}
+		}
+	}
+
+	static bool supported(const Table &table) {
+		if (table.primary_key_columns.empty()) return false;
+		for (size_t column_number : table.primary_key_columns) {
+			const string &column_type(table.columns[column_number].column_type);
+			if (column_type != ColumnTypes::SINT && column_type != ColumnTypes::UINT && column_type != ColumnTypes::BOOL &&
+				column_type != ColumnTypes::REAL && column_type != ColumnTypes::DECI && column_type != ColumnTypes::BLOB) return false;
+		}
+		return true;
+	}
+
+	// returns a negative number if a's key sorts before b's, 0 if they have the same key, or a positive number otherwise;
+	// the rows may be FlatRows, FlatRowViews, or PackedRows
+	template <typename RowA, typename RowB>
+	inline int compare(const RowA &a, const RowB &b) const {
+		for (size_t n = 0; n < primary_key_columns.size(); n++) {
+			int result = compare_functions[n](a[primary_key_columns[n]], b[primary_key_columns[n]]);
+			if (result) return result;
+		}
+		return 0;
+	}
+
+	// as above, but compares the row's key to a key given by itself
+	template <typename Row>
+	inline int compare_to_key(const Row &row, const ColumnValues &key) const {
+		for (size_t n = 0; n < primary_key_columns.size(); n++) {
+			int result = compare_functions[n](row[primary_key_columns[n]], key[n]);
+			if (result) return result;
+		}
+		return 0;
+	}
+
+	// replaces result with the normalized encoding of the row's key; comparing two such encodings with memcmp (or
+	// string's comparison operators) gives the same result as compare() on the rows
+	template <typename Row>
+	inline void normalize_key(const Row &row, string &result) const {
+		result.clear();
+		for (size_t n = 0; n < primary_key_columns.size(); n++) {
+			normalize_functions[n](result, row[primary_key_columns[n]]);
+		}
+	}
+
+	// as above, but for a key given by itself
+	inline void normalize_key_values(const ColumnValues &key, string &result) const {
+		result.clear();
+		for (size_t n = 0; n < primary_key_columns.size(); n++) {
+			normalize_functions[n](result, key[n]);
+		}
+	}
+
+	const ColumnIndices &primary_key_columns;
+	vector<CompareFunction> compare_functions;
+	vector<NormalizeFunction> normalize_functions;
+};
+
+#endif
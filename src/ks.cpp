@@ -1,10 +1,12 @@
 #include <iostream>
 #include <vector>
+#include <memory>
 
 #include "options.h"
 #include "env.h"
 #include "process.h"
 #include "unidirectional_pipe.h"
+#include "shared_memory_ring.h"
 #include "to_string.h"
 
 using namespace std;
@@ -56,13 +58,29 @@ int main(int argc, char *argv[]) {
 			cout << endl;
 		}
 
+		// when both ends run on this host, they can talk through shared memory rings instead of pipes, which saves
+		// copying everything through the kernel; we keep the pipe objects around so we can tell the rings which
+		// processes are using them, which they need to know to notice if the other end dies.
+		bool shared_memory = options.via.empty() && options.shared_memory && SharedMemoryRing::supported();
+		if (options.verbose >= VERY_VERBOSE && shared_memory) cout << "using shared memory rings" << endl;
+		vector<unique_ptr<UnidirectionalPipe>> stdin_pipes, stdout_pipes;
+
 		vector<pid_t> child_pids;
 		for (int worker = 0; worker < options.workers; ++worker) {
-			UnidirectionalPipe stdin_pipe;
-			UnidirectionalPipe stdout_pipe;
-			child_pids.push_back(Process::fork_and_exec(*applicable_from_args, applicable_from_args, stdin_pipe, stdout_pipe));
-			stdout_pipe.dup_read_to(to_descriptor_list_start + worker);
-			stdin_pipe.dup_write_to(to_descriptor_list_start + worker + options.workers);
+			unique_ptr<UnidirectionalPipe> stdin_pipe(shared_memory ? new SharedMemoryPipe : new UnidirectionalPipe);
+			unique_ptr<UnidirectionalPipe> stdout_pipe(shared_memory ? new SharedMemoryPipe : new UnidirectionalPipe);
+			pid_t from_pid = Process::fork_and_exec(*applicable_from_args, applicable_from_args, *stdin_pipe, *stdout_pipe);
+			child_pids.push_back(from_pid);
+			stdin_pipe->started_reader(from_pid);
+			stdout_pipe->started_writer(from_pid);
+			stdout_pipe->dup_read_to(to_descriptor_list_start + worker);
+			stdin_pipe->dup_write_to(to_descriptor_list_start + worker + options.workers);
+			stdin_pipe->close_read();
+			stdin_pipe->close_write();
+			stdout_pipe->close_read();
+			stdout_pipe->close_write();
+			stdin_pipes.push_back(move(stdin_pipe));
+			stdout_pipes.push_back(move(stdout_pipe));
 		}
 
 		// we pass all options to the 'to' end in the environment
@@ -83,12 +101,17 @@ int main(int argc, char *argv[]) {
 		setenv("ENDPOINT_ALTER", options.alter ? "1" : "0", 1);
 		setenv("ENDPOINT_COMMIT_LEVEL", to_string(options.commit_level));
 		setenv("ENDPOINT_HASH_ALGORITHM", to_string(options.hash_algorithm));
+		setenv("ENDPOINT_ROWS_ENCODING", to_string(options.rows_encoding));
 		setenv("ENDPOINT_STRUCTURE_ONLY", to_string(options.structure_only));
+		setenv("ENDPOINT_FAST_APPLY", to_string(options.fast_apply));
 
 		const char *to_args[] = { to_binary.c_str(), "to", nullptr };
-		child_pids.push_back(Process::fork_and_exec(to_binary, to_args));
+		pid_t to_pid = Process::fork_and_exec(to_binary, to_args);
+		child_pids.push_back(to_pid);
 
 		for (int worker = 0; worker < options.workers; ++worker) {
+			stdin_pipes[worker]->started_writer(to_pid);
+			stdout_pipes[worker]->started_reader(to_pid);
 			::close(to_descriptor_list_start + worker);
 			::close(to_descriptor_list_start + worker + options.workers);
 		}
@@ -2,6 +2,7 @@
 
 #include <stdexcept>
 #include <set>
+#include <cstdio>
 #include <mysql.h>
 
 #include "schema.h"
@@ -9,6 +10,42 @@
 #include "row_printer.h"
 
 #define MYSQL_5_6_5 50605
+#define MARIADB_10_2_7 100207
+
+// returns the version of a MariaDB server in the same form as mysql_get_server_version, or 0 for other servers.
+// MariaDB 10 and later report their version prefixed with 5.5.5- to clients that only expect version 5 servers.
+static unsigned long mariadb_server_version(const char *server_info) {
+	if (!strstr(server_info, "MariaDB")) return 0;
+	if (!strncmp(server_info, "5.5.5-", 6)) server_info += 6;
+	unsigned long major = 0, minor = 0, patch = 0;
+	sscanf(server_info, "%lu.%lu.%lu", &major, &minor, &patch);
+	return major*10000 + minor*100 + patch;
+}
+
+// we look at the type of each column once when we get a result, and choose which of MySQLRow's column packing
+// functions to use for it; the index of the function is given by these values.
+enum MySQLColumnPacker {
+	pack_bool_column = 0,
+	pack_sint_column = 1,
+	pack_uint_column = 2,
+	pack_raw_column = 3,
+};
+
+inline MySQLColumnPacker column_packer_for_type(enum_field_types type, bool is_unsigned) {
+	switch (type) {
+		case MYSQL_TYPE_TINY:
+			return pack_bool_column;
+
+		case MYSQL_TYPE_SHORT:
+		case MYSQL_TYPE_INT24:
+		case MYSQL_TYPE_LONG:
+		case MYSQL_TYPE_LONGLONG:
+			return (is_unsigned ? pack_uint_column : pack_sint_column);
+
+		default:
+			return pack_raw_column;
+	}
+}
 
 class MySQLRes {
 public:
@@ -20,12 +57,14 @@ public:
 	inline int n_columns() const { return _n_columns; }
 	inline enum_field_types type_of(int column_number) const { return types[column_number]; }
 	inline bool unsigned_at(int column_number) const { return types_unsigned[column_number]; }
+	inline size_t packer_of(int column_number) const { return packers[column_number]; }
 
 private:
 	MYSQL_RES *_res;
 	int _n_columns;
 	vector<enum_field_types> types;
 	vector<bool> types_unsigned;
+	vector<size_t> packers;
 };
 
 MySQLRes::MySQLRes(MYSQL &mysql, bool buffer) {
@@ -34,10 +73,12 @@ MySQLRes::MySQLRes(MYSQL &mysql, bool buffer) {
 
 	types.resize(_n_columns);
 	types_unsigned.resize(_n_columns);
+	packers.resize(_n_columns);
 	for (size_t i = 0; i < _n_columns; i++) {
 		MYSQL_FIELD *field = mysql_fetch_field(_res);
 		types[i] = field->type;
 		types_unsigned[i] = field->flags & UNSIGNED_FLAG;
+		packers[i] = column_packer_for_type(types[i], types_unsigned[i]);
 	}
 }
 
@@ -69,26 +110,7 @@ public:
 		if (null_at(column_number)) {
 			packer << nullptr;
 		} else {
-			switch (_res.type_of(column_number)) {
-				case MYSQL_TYPE_TINY:
-					packer << bool_at(column_number);
-					break;
-
-				case MYSQL_TYPE_SHORT:
-				case MYSQL_TYPE_INT24:
-				case MYSQL_TYPE_LONG:
-				case MYSQL_TYPE_LONGLONG:
-					if (_res.unsigned_at(column_number)) {
-						packer << uint_at(column_number);
-					} else {
-						packer << int_at(column_number);
-					}
-					break;
-
-				default:
-					// we use our non-copied memory class, equivalent to but faster than using string_at
-					packer << memory(result_at(column_number), length_of(column_number));
-			}
+			ColumnPackers<Packer>::functions[_res.packer_of(column_number)](*this, packer, column_number);
 		}
 	}
 
@@ -101,12 +123,32 @@ public:
 		}
 	}
 
+	template <typename Packer>
+	struct ColumnPackers {
+		typedef void (*Function)(const MySQLRow &row, Packer &packer, int column_number);
+		static const Function functions[];
+
+		static void pack_bool(const MySQLRow &row, Packer &packer, int column_number) { packer << row.bool_at(column_number); }
+		static void pack_sint(const MySQLRow &row, Packer &packer, int column_number) { packer << row.int_at(column_number); }
+		static void pack_uint(const MySQLRow &row, Packer &packer, int column_number) { packer << row.uint_at(column_number); }
+		static void pack_raw (const MySQLRow &row, Packer &packer, int column_number) { packer << memory(row.result_at(column_number), row.length_of(column_number)); } // our non-copied memory class is equivalent to but faster than using string_at
+	};
+
 private:
 	MySQLRes &_res;
 	MYSQL_ROW _row;
 	unsigned long *_lengths;
 };
 
+// in the order given by MySQLColumnPacker
+template <typename Packer>
+const typename MySQLRow::ColumnPackers<Packer>::Function MySQLRow::ColumnPackers<Packer>::functions[] = {
+	&MySQLRow::ColumnPackers<Packer>::pack_bool,
+	&MySQLRow::ColumnPackers<Packer>::pack_sint,
+	&MySQLRow::ColumnPackers<Packer>::pack_uint,
+	&MySQLRow::ColumnPackers<Packer>::pack_raw,
+};
+
 
 class MySQLClient: public SupportsReplace, public SupportsAddNonNullableColumns {
 public:
@@ -129,6 +171,8 @@ public:
 	void execute(const string &sql);
 	void disable_referential_integrity();
 	void enable_referential_integrity();
+	string enable_fast_apply(const Database &database);
+	void disable_fast_apply();
 	string export_snapshot();
 	void import_snapshot(const string &snapshot);
 	void unhold_snapshot();
@@ -136,10 +180,12 @@ public:
 	void start_write_transaction();
 	void commit_transaction();
 	void rollback_transaction();
-	void populate_database_schema(Database &database);
+	void populate_database_schema(Database &database, bool list_partitions);
 	void convert_unsupported_database_schema(Database &database);
 	string escape_value(const string &value);
 	inline string escape_column_value(const Column &column, const string &value) { return escape_value(value); }
+	void append_escaped_value_to(string &result, const uint8_t *value, size_t length);
+	inline void append_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length) { append_escaped_value_to(result, value, length); }
 	string column_type(const Column &column);
 	string column_default(const Table &table, const Column &column);
 	string column_definition(const Table &table, const Column &column);
@@ -147,8 +193,6 @@ public:
 	inline char quote_identifiers_with() const { return '`'; }
 
 protected:
-	friend class MySQLTableLister;
-
 	template <typename RowFunction>
 	size_t query(const string &sql, RowFunction &row_handler, bool buffer) {
 		if (mysql_real_query(&mysql, sql.c_str(), sql.length())) {
@@ -179,6 +223,7 @@ protected:
 
 private:
 	MYSQL mysql;
+	bool unique_checks_disabled;
 
 	// forbid copying
 	MySQLClient(const MySQLClient& copy_from) { throw logic_error("copying forbidden"); }
@@ -189,7 +234,7 @@ MySQLClient::MySQLClient(
 	const string &database_port,
 	const string &database_name,
 	const string &database_username,
-	const string &database_password) {
+	const string &database_password): unique_checks_disabled(false) {
 
 	// mysql_real_connect takes separate params for numeric ports and unix domain sockets
 	int port = 0;
@@ -299,14 +344,59 @@ void MySQLClient::enable_referential_integrity() {
 	execute("SET foreign_key_checks = 1");
 }
 
+string MySQLClient::enable_fast_apply(const Database &database) {
+	// foreign key checks are already off (see disable_referential_integrity), and there's no way to turn off
+	// triggers for a session.  turning off unique checks lets InnoDB skip reading secondary unique indexes,
+	// but then REPLACE wouldn't find the rows that conflict with them either, so we can only do that if there
+	// aren't any.
+	string result;
+	for (const Table &table : database.tables) {
+		for (const Key &key : table.keys) {
+			if (key.unique && result.empty()) {
+				result = "unique checks left on because " + table.name + " has unique key " + key.name;
+			}
+		}
+	}
+	if (result.empty()) {
+		execute("SET unique_checks = 0");
+		unique_checks_disabled = true;
+		result = "unique checks disabled";
+	}
+
+	// we don't turn off binary logging ourselves, since any replicas would then silently stop matching
+	if (select_one("SELECT @@log_bin AND @@sql_log_bin") == "1") {
+		result += "; binary logging is on (use --set-to-variables=sql_log_bin=0 to turn it off if there are no replicas)";
+	}
+
+	// in the traditional lock mode, each insert into a table with an auto-increment column holds a table lock
+	if (select_one("SELECT @@innodb_autoinc_lock_mode") == "0") {
+		result += "; innodb_autoinc_lock_mode is 0, so inserts into tables with auto-increment columns will lock the table";
+	}
+
+	return result;
+}
+
+void MySQLClient::disable_fast_apply() {
+	if (unique_checks_disabled) {
+		execute("SET unique_checks = 1");
+		unique_checks_disabled = false;
+	}
+}
+
 string MySQLClient::escape_value(const string &value) {
 	string result;
-	result.resize(value.size()*2 + 1);
-	size_t result_length = mysql_real_escape_string(&mysql, (char*)result.data(), value.c_str(), value.size());
-	result.resize(result_length);
+	append_escaped_value_to(result, (const uint8_t *)value.data(), value.size());
 	return result;
 }
 
+void MySQLClient::append_escaped_value_to(string &result, const uint8_t *value, size_t length) {
+	// escape straight into the end of the statement we're building, rather than into a temporary string
+	size_t start = result.size();
+	result.resize(start + length*2 + 1);
+	size_t result_length = mysql_real_escape_string(&mysql, &result[start], (const char *)value, length);
+	result.resize(start + result_length);
+}
+
 void MySQLClient::convert_unsupported_database_schema(Database &database) {
 	// nothing yet
 }
@@ -468,15 +558,20 @@ string MySQLClient::column_definition(const Table &table, const Column &column)
 }
 
 struct MySQLColumnLister {
-	inline MySQLColumnLister(Table &table): table(table) {}
+	inline MySQLColumnLister(TableFinder &tables, bool quoted_defaults): tables(tables), quoted_defaults(quoted_defaults) {}
 
 	inline void operator()(MySQLRow &row) {
-		string name(row.string_at(0));
-		string db_type(row.string_at(1));
-		bool nullable(row.string_at(2) == "YES");
+		Table *found = tables.find(row.string_at(0));
+		if (!found) return; // created since we listed the tables
+		Table &table(*found);
+
+		string name(row.string_at(1));
+		string db_type(row.string_at(2));
+		bool nullable(row.string_at(3) == "YES");
 		bool unsign(db_type.length() > 8 && db_type.substr(db_type.length() - 8, 8) == "unsigned");
 		DefaultType default_type(row.null_at(4) ? DefaultType::no_default : DefaultType::default_value);
 		string default_value(default_type ? row.string_at(4) : string(""));
+		if (quoted_defaults && default_type) unquote_default(default_type, default_value);
 		if (row.string_at(5).find("auto_increment") != string::npos) default_type = DefaultType::sequence;
 
 		if (db_type == "tinyint(1)" && (!default_type || default_value == "0" || default_value == "1")) {
@@ -530,16 +625,38 @@ struct MySQLColumnLister {
 		}
 	}
 
-	Table &table;
+	inline void unquote_default(DefaultType &default_type, string &default_value) {
+		// mariadb 10.2.7 and later quote literal defaults in information_schema (but not in SHOW COLUMNS) to
+		// distinguish them from expressions, and give NULL defaults as the word NULL
+		if (default_value == "NULL") {
+			default_type = DefaultType::no_default;
+			default_value = "";
+		} else if (default_value.length() >= 2 && default_value.front() == '\'' && default_value.back() == '\'') {
+			string result;
+			result.reserve(default_value.length() - 2);
+			for (string::size_type n = 1; n < default_value.length() - 1; n++) {
+				if (default_value[n] == '\\' || default_value[n] == '\'') n++;
+				result += default_value[n];
+			}
+			default_value = result;
+		}
+	}
+
+	TableFinder &tables;
+	bool quoted_defaults;
 };
 
 struct MySQLKeyLister {
-	inline MySQLKeyLister(Table &table): table(table) {}
+	inline MySQLKeyLister(TableFinder &tables): tables(tables) {}
 
 	inline void operator()(MySQLRow &row) {
+		Table *found = tables.find(row.string_at(0));
+		if (!found) return; // as for MySQLColumnLister
+		Table &table(*found);
+
 		bool unique = (row.string_at(1) == "0");
 		string key_name = row.string_at(2);
-		string column_name = row.string_at(4);
+		string column_name = row.string_at(3);
 		size_t column_index = table.index_of_column(column_name);
 		// FUTURE: consider representing collation, sub_part, packed, index_type, and perhaps comment/index_comment
 
@@ -555,38 +672,89 @@ struct MySQLKeyLister {
 			table.keys.back().columns.push_back(column_index);
 
 			if (table.primary_key_columns.empty()) {
-				// if we have no primary key, we might need to use another unique key as a surrogate - see MySQLTableLister below -
+				// if we have no primary key, we might need to use another unique key as a surrogate - see populate_database_schema below -
 				// but this key must have no NULLable columns, as they effectively make the index not unique
-				string nullable = row.string_at(9);
+				string nullable = row.string_at(4);
 				if (unique && nullable == "YES") {
 					// mark this as unusable
-					unique_but_nullable_keys.insert(key_name);
+					unique_but_nullable_keys.insert(make_pair(table.name, key_name));
 				}
 			}
 		}
 	}
 
-	Table &table;
-	set<string> unique_but_nullable_keys;
+	TableFinder &tables;
+	set< pair<string, string> > unique_but_nullable_keys;
+};
+
+struct MySQLPartitionLister {
+	inline MySQLPartitionLister(TableFinder &tables): tables(tables) {}
+
+	inline void operator()(MySQLRow &row) {
+		Table *table = tables.find(row.string_at(0));
+		if (!table) return; // as for MySQLColumnLister
+
+		// mysql lets us name the partition to use after the table name in each of the statements we run
+		string partition_name(table->name + " PARTITION (" + row.string_at(1) + ")");
+		if (!table->partitions.empty() && table->partitions.back().name == partition_name) return; // another subpartition of the same partition
+
+		string definition(row.string_at(2) + " (" + row.string_at(3) + ")");
+		if (!row.null_at(4)) definition += " VALUES " + row.string_at(4);
+		if (!row.null_at(5)) definition += " SUBPARTITION BY " + row.string_at(5) + " (" + row.string_at(6) + ")";
+		table->partitions.push_back(Partition(partition_name, definition));
+	}
+
+	TableFinder &tables;
 };
 
 struct MySQLTableLister {
-	inline MySQLTableLister(MySQLClient &client, Database &database): client(client), database(database) {}
+	inline MySQLTableLister(Database &database): database(database) {}
 
 	inline void operator()(MySQLRow &row) {
-		Table table(row.string_at(0));
+		database.tables.push_back(Table(row.string_at(0)));
+	}
 
-		MySQLColumnLister column_lister(table);
-		client.query("SHOW COLUMNS FROM " + table.name, column_lister, false);
+	Database &database;
+};
 
-		MySQLKeyLister key_lister(table);
-		client.query("SHOW KEYS FROM " + table.name, key_lister, false);
+void MySQLClient::populate_database_schema(Database &database, bool list_partitions) {
+	MySQLTableLister table_lister(database);
+	query("SELECT table_name FROM information_schema.tables WHERE table_schema = schema() ORDER BY data_length DESC, table_name ASC", table_lister, false);
+
+	// rather than running SHOW COLUMNS and SHOW KEYS for each table, which takes a long time for schemas with
+	// thousands of tables, we list the columns and keys of all the tables at once and then pick them out by name
+	TableFinder tables(database.tables);
+
+	MySQLColumnLister column_lister(tables, mariadb_server_version(mysql_get_server_info(&mysql)) >= MARIADB_10_2_7);
+	query("SELECT table_name, column_name, column_type, is_nullable, column_default, extra "
+		    "FROM information_schema.columns "
+		   "WHERE table_schema = schema() "
+		   "ORDER BY table_name, ordinal_position",
+		  column_lister, false);
+
+	MySQLKeyLister key_lister(tables);
+	query("SELECT table_name, non_unique, index_name, column_name, nullable "
+		    "FROM information_schema.statistics "
+		   "WHERE table_schema = schema() "
+		   "ORDER BY table_name, index_name = 'PRIMARY' DESC, index_name, seq_in_index",
+		  key_lister, false);
+
+	if (list_partitions) {
+		MySQLPartitionLister partition_lister(tables);
+		query("SELECT table_name, partition_name, partition_method, partition_expression, partition_description, subpartition_method, subpartition_expression "
+			    "FROM information_schema.partitions "
+			   "WHERE table_schema = schema() AND "
+			         "partition_name IS NOT NULL "
+			   "ORDER BY table_name, partition_ordinal_position, subpartition_ordinal_position",
+			  partition_lister, false);
+	}
 
-		// if the table has no primary key, we need to find a unique key with no nullable columns to act as a surrogate primary key
+	for (Table &table : database.tables) {
+		// if the table has no primary key, we need to find a unique key with no nullable columns to act as a surrogate primary key
 		sort(table.keys.begin(), table.keys.end()); // order is arbitrary for keys, but both ends must be consistent, so we sort the keys by name
 
 		for (Keys::const_iterator key = table.keys.begin(); key != table.keys.end() && table.primary_key_columns.empty(); ++key) {
-			if (key->unique && !key_lister.unique_but_nullable_keys.count(key->name)) {
+			if (key->unique && !key_lister.unique_but_nullable_keys.count(make_pair(table.name, key->name))) {
 				table.primary_key_columns = key->columns;
 			}
 		}
@@ -594,18 +762,7 @@ struct MySQLTableLister {
 			// of course this falls apart if there are no unique keys, so we don't allow that
 			throw runtime_error("Couldn't find a primary or non-nullable unique key on table " + table.name);
 		}
-
-		database.tables.push_back(table);
 	}
-
-private:
-	MySQLClient &client;
-	Database &database;
-};
-
-void MySQLClient::populate_database_schema(Database &database) {
-	MySQLTableLister table_lister(*this, database);
-	query("SELECT table_name FROM information_schema.tables WHERE table_schema = schema() ORDER BY data_length DESC, table_name ASC", table_lister, true /* buffer so we can make further queries during iteration */);
 }
 
 
@@ -2,15 +2,110 @@
 
 #include <stdexcept>
 #include <set>
+#include <map>
+#include <memory>
 #include <libpq-fe.h>
 
 #include "schema.h"
 #include "database_client_traits.h"
 #include "row_printer.h"
+#include "postgresql_binary_format.h"
+
+// from pg_type.h, which isn't available/working on all distributions.
+#define BOOLOID			16
+#define BYTEAOID		17
+#define INT2OID			21
+#define INT4OID			23
+#define INT8OID			20
+#define TEXTOID			25
+#define BPCHAROID		1042
+#define VARCHAROID		1043
+#define DATEOID			1082
+#define TIMEOID			1083
+#define TIMESTAMPOID	1114
+#define NUMERICOID		1700
+
+#ifdef LIBPQ_HAS_CHUNK_MODE
+const int STREAMED_ROWS_PER_CHUNK = 1000;
+#endif
+
+// we look at the type of each column once when we get a result, and choose which of PostgreSQLRow's column packing
+// functions to use for it; the index of the function is given by these values.
+enum PostgreSQLColumnPacker {
+	pack_bool_column = 0,
+	pack_bytea_column = 1,
+	pack_int_column = 2,
+	pack_raw_column = 3,
+	pack_binary_bool_column = 4,
+	pack_binary_int2_column = 5,
+	pack_binary_int4_column = 6,
+	pack_binary_int8_column = 7,
+	pack_binary_numeric_column = 8,
+	pack_binary_date_column = 9,
+	pack_binary_time_column = 10,
+	pack_binary_timestamp_column = 11,
+};
+
+inline PostgreSQLColumnPacker column_packer_for_type(Oid type) {
+	switch (type) {
+		case BOOLOID:
+			return pack_bool_column;
+
+		case BYTEAOID:
+			return pack_bytea_column;
+
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+			return pack_int_column;
+
+		default:
+			return pack_raw_column;
+	}
+}
+
+// for binary-format results, which we only request for retrieve_rows, having cast any other types to text
+inline PostgreSQLColumnPacker binary_column_packer_for_type(Oid type) {
+	switch (type) {
+		case BOOLOID:
+			return pack_binary_bool_column;
+
+		case BYTEAOID:
+		case TEXTOID:
+		case BPCHAROID:
+		case VARCHAROID:
+			return pack_raw_column; // the binary format of these is simply the bytes themselves
+
+		case INT2OID:
+			return pack_binary_int2_column;
+
+		case INT4OID:
+			return pack_binary_int4_column;
+
+		case INT8OID:
+			return pack_binary_int8_column;
+
+		case NUMERICOID:
+			return pack_binary_numeric_column;
+
+		case DATEOID:
+			return pack_binary_date_column;
+
+		case TIMEOID:
+			return pack_binary_time_column;
+
+		case TIMESTAMPOID:
+			return pack_binary_timestamp_column;
+
+		default:
+			throw logic_error("Don't know how to decode binary results of postgresql type " + to_string(type));
+	}
+}
 
 class PostgreSQLRes {
 public:
-	PostgreSQLRes(PGresult *res);
+	PostgreSQLRes(PGresult *res, bool binary_results = false);
+	PostgreSQLRes(PGresult *res, const vector<size_t> &copy_packers);
 	~PostgreSQLRes();
 
 	inline PGresult *res() { return _res; }
@@ -18,39 +113,65 @@ public:
 	inline int n_tuples() const  { return _n_tuples; }
 	inline int n_columns() const { return _n_columns; }
 	inline Oid type_of(int column_number) const { return types[column_number]; }
+	inline size_t packer_of(int column_number) const { return packers[column_number]; }
+
+	// takes the next result from a query being streamed, which has the same columns as the previous result
+	void next_result(PGresult *res);
+
+	string formatted; // reused to format values from binary results
+
+	// for COPY, the rows aren't in the result; each row of data is parsed into these instead, with a length of -1
+	// for null values
+	bool copying;
+	vector<const char *> copied_values;
+	vector<int> copied_lengths;
 
 private:
 	PGresult *_res;
 	int _n_tuples;
 	int _n_columns;
 	vector<Oid> types;
+	vector<size_t> packers;
 };
 
-PostgreSQLRes::PostgreSQLRes(PGresult *res) {
+PostgreSQLRes::PostgreSQLRes(PGresult *res, bool binary_results): copying(false) {
 	_res = res;
 
 	_n_tuples = PQntuples(_res);
 	_n_columns = PQnfields(_res);
 
 	types.resize(_n_columns);
+	packers.resize(_n_columns);
 	for (size_t i = 0; i < _n_columns; i++) {
 		types[i] = PQftype(_res, i);
+		packers[i] = (binary_results ? binary_column_packer_for_type(types[i]) : column_packer_for_type(types[i]));
 	}
 }
 
-PostgreSQLRes::~PostgreSQLRes() {
+PostgreSQLRes::PostgreSQLRes(PGresult *res, const vector<size_t> &copy_packers): copying(true), packers(copy_packers) {
+	// COPY doesn't tell us the column types, so the caller chooses the packers
+	_res = res;
+	_n_tuples = 0;
+	_n_columns = packers.size();
+	types.resize(_n_columns);
+	copied_values.resize(_n_columns);
+	copied_lengths.resize(_n_columns);
+}
+
+void PostgreSQLRes::next_result(PGresult *res) {
 	if (_res) {
 		PQclear(_res);
 	}
+	_res = res;
+	_n_tuples = PQntuples(_res);
 }
 
+PostgreSQLRes::~PostgreSQLRes() {
+	if (_res) {
+		PQclear(_res);
+	}
+}
 
-// from pg_type.h, which isn't available/working on all distributions.
-#define BOOLOID			16
-#define BYTEAOID		17
-#define INT2OID			21
-#define INT4OID			23
-#define INT8OID			20
 
 class PostgreSQLRow {
 public:
@@ -59,9 +180,9 @@ public:
 
 	inline         int n_columns() const { return _res.n_columns(); }
 
-	inline        bool   null_at(int column_number) const { return PQgetisnull(_res.res(), _row_number, column_number); }
-	inline const void *result_at(int column_number) const { return PQgetvalue (_res.res(), _row_number, column_number); }
-	inline         int length_of(int column_number) const { return PQgetlength(_res.res(), _row_number, column_number); }
+	inline        bool   null_at(int column_number) const { return (_res.copying ? _res.copied_lengths[column_number] < 0 : PQgetisnull(_res.res(), _row_number, column_number)); }
+	inline const void *result_at(int column_number) const { return (_res.copying ? _res.copied_values[column_number]       : PQgetvalue (_res.res(), _row_number, column_number)); }
+	inline         int length_of(int column_number) const { return (_res.copying ? _res.copied_lengths[column_number]      : PQgetlength(_res.res(), _row_number, column_number)); }
 	inline      string string_at(int column_number) const { return string((const char *)result_at(column_number), length_of(column_number)); }
 	inline        bool   bool_at(int column_number) const { return (strcmp((const char *)result_at(column_number), "t") == 0); }
 	inline     int64_t    int_at(int column_number) const { return strtoll((const char *)result_at(column_number), NULL, 10); }
@@ -73,25 +194,7 @@ public:
 		if (null_at(column_number)) {
 			packer << nullptr;
 		} else {
-			switch (_res.type_of(column_number)) {
-				case BOOLOID:
-					packer << bool_at(column_number);
-					break;
-
-				case BYTEAOID:
-					packer << decoded_byte_string_at(column_number);
-					break;
-
-				case INT2OID:
-				case INT4OID:
-				case INT8OID:
-					packer << int_at(column_number);
-					break;
-
-				default:
-					// we use our non-copied memory class, equivalent to but faster than using string_at
-					packer << memory(result_at(column_number), length_of(column_number));
-			}
+			ColumnPackers<Packer>::functions[_res.packer_of(column_number)](*this, packer, column_number);
 		}
 	}
 
@@ -104,11 +207,55 @@ public:
 		}
 	}
 
+	template <typename Packer>
+	struct ColumnPackers {
+		typedef void (*Function)(const PostgreSQLRow &row, Packer &packer, int column_number);
+		static const Function functions[];
+
+		static void pack_bool (const PostgreSQLRow &row, Packer &packer, int column_number) { packer << row.bool_at(column_number); }
+		static void pack_bytea(const PostgreSQLRow &row, Packer &packer, int column_number) { packer << row.decoded_byte_string_at(column_number); }
+		static void pack_int  (const PostgreSQLRow &row, Packer &packer, int column_number) { packer << row.int_at(column_number); }
+		static void pack_raw  (const PostgreSQLRow &row, Packer &packer, int column_number) { packer << memory(row.result_at(column_number), row.length_of(column_number)); } // our non-copied memory class is equivalent to but faster than using string_at
+
+		static void pack_binary_bool(const PostgreSQLRow &row, Packer &packer, int column_number) { packer << (*(const uint8_t *)row.result_at(column_number) != 0); }
+		static void pack_binary_int2(const PostgreSQLRow &row, Packer &packer, int column_number) { packer << (int64_t)(int16_t)binary_uint16_at((const uint8_t *)row.result_at(column_number)); }
+		static void pack_binary_int4(const PostgreSQLRow &row, Packer &packer, int column_number) { packer << (int64_t)(int32_t)binary_uint32_at((const uint8_t *)row.result_at(column_number)); }
+		static void pack_binary_int8(const PostgreSQLRow &row, Packer &packer, int column_number) { packer << (int64_t)binary_uint64_at((const uint8_t *)row.result_at(column_number)); }
+		static void pack_binary_numeric  (const PostgreSQLRow &row, Packer &packer, int column_number) { pack_formatted(row, packer, column_number, &append_binary_numeric); }
+		static void pack_binary_date     (const PostgreSQLRow &row, Packer &packer, int column_number) { pack_formatted(row, packer, column_number, &append_binary_date); }
+		static void pack_binary_time     (const PostgreSQLRow &row, Packer &packer, int column_number) { pack_formatted(row, packer, column_number, &append_binary_time); }
+		static void pack_binary_timestamp(const PostgreSQLRow &row, Packer &packer, int column_number) { pack_formatted(row, packer, column_number, &append_binary_timestamp); }
+
+		static inline void pack_formatted(const PostgreSQLRow &row, Packer &packer, int column_number, void (*format)(string &result, const uint8_t *data, size_t length)) {
+			string &formatted(row._res.formatted);
+			formatted.clear();
+			format(formatted, (const uint8_t *)row.result_at(column_number), row.length_of(column_number));
+			packer << memory(formatted.data(), formatted.size());
+		}
+	};
+
 private:
 	PostgreSQLRes &_res;
 	int _row_number;
 };
 
+// in the order given by PostgreSQLColumnPacker
+template <typename Packer>
+const typename PostgreSQLRow::ColumnPackers<Packer>::Function PostgreSQLRow::ColumnPackers<Packer>::functions[] = {
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_bool,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_bytea,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_int,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_raw,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_bool,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_int2,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_int4,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_int8,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_numeric,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_date,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_time,
+	&PostgreSQLRow::ColumnPackers<Packer>::pack_binary_timestamp,
+};
+
 string PostgreSQLRow::decoded_byte_string_at(int column_number) const {
 	const unsigned char *value = (const unsigned char *)result_at(column_number);
 	size_t decoded_length;
@@ -119,7 +266,7 @@ string PostgreSQLRow::decoded_byte_string_at(int column_number) const {
 }
 
 
-class PostgreSQLClient: public GlobalKeys, public SequenceColumns, public DropKeysWhenColumnsDropped, public SetNullability {
+class PostgreSQLClient: public GlobalKeys, public SequenceColumns, public DropKeysWhenColumnsDropped, public SetNullability, public SupportsCopy, public SupportsUpsert, public SupportsPipelining {
 public:
 	typedef PostgreSQLRow RowType;
 
@@ -133,13 +280,36 @@ public:
 
 	template <typename RowReceiver>
 	size_t retrieve_rows(RowReceiver &row_receiver, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count = NO_ROW_COUNT_LIMIT) {
-		return query(retrieve_rows_sql(*this, table, prev_key, last_key, row_count), row_receiver);
+		// binary-format results save converting integers from text and unescaping bytea values, which is most of
+		// the work for tables with large bytea values; see binary_select_columns_sql for the types we decode
+		bool binary_results = binary_results_supported(table);
+
+		// the rest of the table can be sent with a single COPY, which the server produces faster than any
+		// SELECT, and which saves the caller retrieving it in batches, each of which has to seek to its start
+		if (row_count == NO_ROW_COUNT_LIMIT && last_key.empty() && binary_results) {
+			return copy_rows_out(row_receiver, table, prev_key);
+		}
+
+		const PreparedStatement &statement(prepared_range_statement(table,
+			row_count == NO_ROW_COUNT_LIMIT ? retrieve_rows_statement : retrieve_limited_rows_statement, !prev_key.empty(), !last_key.empty()));
+		set_range_parameters(table, prev_key, last_key, row_count);
+
+		if (!PQsendQueryPrepared(conn, statement.name.c_str(), parameter_pointers.size(), parameter_pointers.data(), nullptr, nullptr, binary_results ? 1 : 0)) {
+			backtrace();
+			throw runtime_error(sql_error(statement.sql));
+		}
+		return stream_results(statement.sql, row_receiver, binary_results);
 	}
 
 	size_t count_rows(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key);
 	void execute(const string &sql);
+	void copy_rows_in(const string &sql, const string &data);
+	bool enter_pipeline_mode();
+	void sync_pipeline();
 	void disable_referential_integrity();
 	void enable_referential_integrity();
+	string enable_fast_apply(const Database &database);
+	void disable_fast_apply();
 	string export_snapshot();
 	void import_snapshot(const string &snapshot);
 	void unhold_snapshot();
@@ -147,23 +317,31 @@ public:
 	void start_write_transaction();
 	void commit_transaction();
 	void rollback_transaction();
-	void populate_database_schema(Database &database);
+	void populate_database_schema(Database &database, bool list_partitions);
 	void convert_unsupported_database_schema(Database &database);
 	string escape_value(const string &value);
 	string escape_column_value(const Column &column, const string &value);
+	void append_escaped_value_to(string &result, const uint8_t *value, size_t length);
+	void append_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length);
+	void append_copy_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length);
 	string column_type(const Column &column);
 	string column_sequence_name(const Table &table, const Column &column);
 	string column_default(const Table &table, const Column &column);
 	string column_definition(const Table &table, const Column &column);
 
 	inline char quote_identifiers_with() const { return '"'; }
+	inline void append_parameter_placeholder_to(string &result, size_t parameter) const { result += '$'; append_integer(result, parameter); }
+	inline bool supports_upsert() const { return insert_on_conflict; }
 
 protected:
-	friend class PostgreSQLTableLister;
-
+	// if buffer is false, the rows are passed to row_handler as they arrive rather than after the whole result has
+	// been received, so memory use doesn't depend on the size of the result and we can process the rows while
+	// the server is still sending them; but as for MySQLClient, no other queries can be run until it has finished.
 	template <typename RowFunction>
-	size_t query(const string &sql, RowFunction &row_handler) {
-		PostgreSQLRes res(PQexecParams(conn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0 /* text-format results only */));
+	size_t query(const string &sql, RowFunction &row_handler, bool buffer = true, bool binary_results = false) {
+		if (!buffer) return stream_query(sql, row_handler, binary_results);
+
+		PostgreSQLRes res(PQexecParams(conn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, binary_results ? 1 : 0), binary_results);
 
 		if (res.status() != PGRES_TUPLES_OK) {
 			backtrace();
@@ -178,11 +356,180 @@ protected:
 		return res.n_tuples();
 	}
 
+	template <typename RowFunction>
+	size_t stream_query(const string &sql, RowFunction &row_handler, bool binary_results) {
+		if (!PQsendQueryParams(conn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, binary_results ? 1 : 0)) {
+			backtrace();
+			throw runtime_error(sql_error(sql));
+		}
+		return stream_results(sql, row_handler, binary_results);
+	}
+
+	// receives the results of the query that has just been sent, passing each row to row_handler as it arrives
+	template <typename RowFunction>
+	size_t stream_results(const string &sql, RowFunction &row_handler, bool binary_results) {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+		// newer versions of libpq can give us the rows in batches, which saves making a result object for each row
+		if (!PQsetChunkedRowsMode(conn, STREAMED_ROWS_PER_CHUNK)) {
+#else
+		if (!PQsetSingleRowMode(conn)) {
+#endif
+			abandon_query();
+			throw runtime_error(sql_error(sql));
+		}
+
+		PostgreSQLRes res(PQgetResult(conn), binary_results);
+		size_t rows = 0;
+
+		try {
+			while (streamed_rows_result(res.status())) {
+				for (int row_number = 0; row_number < res.n_tuples(); row_number++) {
+					PostgreSQLRow row(res, row_number);
+					row_handler(row);
+				}
+				rows += res.n_tuples();
+				res.next_result(PQgetResult(conn));
+			}
+		} catch (...) {
+			abandon_query();
+			throw;
+		}
+
+		if (res.status() != PGRES_TUPLES_OK) {
+			backtrace();
+			string error(sql_error(sql));
+			abandon_query();
+			throw runtime_error(error);
+		}
+
+		// the final result tells us that all the rows have been sent; there's nothing else to come
+		if (PGresult *extra_result = PQgetResult(conn)) PQclear(extra_result);
+		return rows;
+	}
+
+	template <typename RowFunction>
+	size_t copy_rows_out(RowFunction &row_handler, const Table &table, const ColumnValues &prev_key) {
+		string sql("COPY (");
+		sql += retrieve_rows_sql(*this, table, binary_select_columns_sql(table), prev_key, ColumnValues());
+		sql += ") TO STDOUT WITH BINARY";
+
+		PostgreSQLRes res(PQexec(conn, sql.c_str()), binary_copy_packers(table));
+
+		if (res.status() != PGRES_COPY_OUT) {
+			backtrace();
+			throw runtime_error(sql_error(sql));
+		}
+
+		size_t rows = 0;
+		bool header_read = false;
+		int length;
+
+		try {
+			while (true) {
+				// libpq gives us the data one row at a time
+				char *data;
+				length = PQgetCopyData(conn, &data, 0 /* wait for data */);
+				if (length < 0) break;
+				unique_ptr<char, void (*)(void *)> data_freer(data, &PQfreemem);
+
+				if (read_binary_copy_row(res, (const uint8_t *)data, length, header_read)) {
+					PostgreSQLRow row(res, 0);
+					row_handler(row);
+					rows++;
+				}
+			}
+		} catch (...) {
+			abandon_copy_out();
+			throw;
+		}
+
+		// -1 means the copy has finished, and we can get its result; -2 means it failed
+		PostgreSQLRes copy_res(PQgetResult(conn));
+		if (length != -1 || copy_res.status() != PGRES_COMMAND_OK) {
+			backtrace();
+			string error(sql_error(sql));
+			abandon_query();
+			throw runtime_error(error);
+		}
+		if (PGresult *extra_result = PQgetResult(conn)) PQclear(extra_result);
+		return rows;
+	}
+
+	// as abandon_query(), but for COPY TO, where we first have to read and discard the rest of the data
+	void abandon_copy_out() {
+		if (PGcancel *cancel = PQgetCancel(conn)) {
+			char error[256];
+			PQcancel(cancel, error, sizeof(error));
+			PQfreeCancel(cancel);
+		}
+		char *data;
+		while (PQgetCopyData(conn, &data, 0) >= 0) {
+			PQfreemem(data);
+		}
+		while (PGresult *result = PQgetResult(conn)) {
+			PQclear(result);
+		}
+	}
+
+	static inline bool streamed_rows_result(ExecStatusType status) {
+#ifdef LIBPQ_HAS_CHUNK_MODE
+		return (status == PGRES_SINGLE_TUPLE || status == PGRES_TUPLES_CHUNK);
+#else
+		return (status == PGRES_SINGLE_TUPLE);
+#endif
+	}
+
+	// cancels the query being streamed and discards anything the server has already sent for it, so that the
+	// connection can be used again
+	void abandon_query() {
+		if (PGcancel *cancel = PQgetCancel(conn)) {
+			char error[256];
+			PQcancel(cancel, error, sizeof(error));
+			PQfreeCancel(cancel);
+		}
+		while (PGresult *result = PQgetResult(conn)) {
+			PQclear(result);
+		}
+	}
+
+	// we prepare the statements used to retrieve and count ranges of rows the first time we need them for each
+	// table, so that the server doesn't have to parse and plan them every time, and we don't have to escape the
+	// key values into the statement
+	enum PreparedRangeStatementType {
+		count_rows_statement = 'c',
+		retrieve_rows_statement = 'r',
+		retrieve_limited_rows_statement = 'l',
+	};
+
+	struct PreparedStatement {
+		string name;
+		string sql; // for error messages
+	};
+
+	const PreparedStatement &prepared_range_statement(const Table &table, PreparedRangeStatementType type, bool prev_key_given, bool last_key_given);
+	void set_range_parameters(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count);
+	void append_parameter_value_to(string &result, const Column &column, const PackedValueView &value);
+	void append_bytea_input_to(string &result, const uint8_t *value, size_t length, const char *backslash);
+
 	string select_one(const string &sql);
 	string sql_error(const string &sql);
+	string statement_for_error(const string &sql);
+
+	bool binary_results_supported(const Table &table);
+	string binary_select_columns_sql(const Table &table);
+	vector<size_t> binary_copy_packers(const Table &table);
+	bool read_binary_copy_row(PostgreSQLRes &res, const uint8_t *data, size_t length, bool &header_read);
 
 private:
 	PGconn *conn;
+	bool hex_bytea_input;
+	bool hex_bytea_literals;
+	bool insert_on_conflict;
+	vector<string> pipelined_statements; // abbreviated, for error messages
+	map<string, PreparedStatement> prepared_statements;
+	vector<string> parameter_values;
+	vector<const char *> parameter_pointers;
+	bool binary_datetimes;
 
 	// forbid copying
 	PostgreSQLClient(const PostgreSQLClient& copy_from) { throw logic_error("copying forbidden"); }
@@ -208,6 +555,19 @@ PostgreSQLClient::PostgreSQLClient(
 	}
 
 	execute("SET client_min_messages TO WARNING");
+
+	// with standard_conforming_strings on, a hex bytea value can be written into a string literal without any
+	// further escaping, so we can generate it ourselves; see append_escaped_column_value_to
+	const char *standard_conforming_strings = PQparameterStatus(conn, "standard_conforming_strings");
+	hex_bytea_input = (PQserverVersion(conn) >= 90000);
+	insert_on_conflict = (PQserverVersion(conn) >= 90500);
+	hex_bytea_literals = (hex_bytea_input && standard_conforming_strings && strcmp(standard_conforming_strings, "on") == 0);
+
+	// we can only produce the same text as the server for dates and times if it's using the ISO style, and
+	// the binary format for times is only integers if the server was built with integer datetimes (the default)
+	const char *date_style = PQparameterStatus(conn, "DateStyle");
+	const char *integer_datetimes = PQparameterStatus(conn, "integer_datetimes");
+	binary_datetimes = (date_style && strncmp(date_style, "ISO", 3) == 0 && integer_datetimes && strcmp(integer_datetimes, "on") == 0);
 }
 
 PostgreSQLClient::~PostgreSQLClient() {
@@ -217,10 +577,105 @@ PostgreSQLClient::~PostgreSQLClient() {
 }
 
 size_t PostgreSQLClient::count_rows(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key) {
-	return atoi(select_one(count_rows_sql(*this, table, prev_key, last_key)).c_str());
+	const PreparedStatement &statement(prepared_range_statement(table, count_rows_statement, !prev_key.empty(), !last_key.empty()));
+	set_range_parameters(table, prev_key, last_key, NO_ROW_COUNT_LIMIT);
+	PostgreSQLRes res(PQexecPrepared(conn, statement.name.c_str(), parameter_pointers.size(), parameter_pointers.data(), nullptr, nullptr, 0));
+
+	if (res.status() != PGRES_TUPLES_OK) {
+		backtrace();
+		throw runtime_error(sql_error(statement.sql));
+	}
+
+	if (res.n_tuples() != 1 || res.n_columns() != 1) {
+		throw runtime_error("Expected query to return only one row with only one column\n" + statement.sql);
+	}
+
+	return atoi(PostgreSQLRow(res, 0).string_at(0).c_str());
+}
+
+const PostgreSQLClient::PreparedStatement &PostgreSQLClient::prepared_range_statement(const Table &table, PreparedRangeStatementType type, bool prev_key_given, bool last_key_given) {
+	string key(table.name);
+	key += '\0';
+	key += (char)type;
+	key += (prev_key_given ? 'p' : '-');
+	key += (last_key_given ? 'l' : '-');
+
+	map<string, PreparedStatement>::const_iterator existing = prepared_statements.find(key);
+	if (existing != prepared_statements.end()) return existing->second;
+
+	PreparedStatement statement;
+	statement.name = "ks_range_" + to_string(prepared_statements.size() + 1);
+	if (type == count_rows_statement) {
+		statement.sql = parameterized_count_rows_sql(*this, table, prev_key_given, last_key_given);
+	} else {
+		string select_columns(binary_results_supported(table) ? binary_select_columns_sql(table) : select_columns_sql(*this, table));
+		statement.sql = parameterized_retrieve_rows_sql(*this, table, select_columns, prev_key_given, last_key_given, type == retrieve_limited_rows_statement);
+	}
+
+	PostgreSQLRes res(PQprepare(conn, statement.name.c_str(), statement.sql.c_str(), 0, nullptr));
+	if (res.status() != PGRES_COMMAND_OK) {
+		throw runtime_error(sql_error(statement.sql));
+	}
+
+	return prepared_statements[key] = statement;
+}
+
+void PostgreSQLClient::set_range_parameters(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count) {
+	// the parameters are given in text format, as nul-terminated strings; we reuse the strings' buffers
+	size_t parameters = prev_key.size() + last_key.size() + (row_count == NO_ROW_COUNT_LIMIT ? 0 : 1);
+	if (parameter_values.size() < parameters) parameter_values.resize(parameters);
+
+	size_t parameter = 0;
+	for (size_t n = 0; n < prev_key.size(); n++) {
+		parameter_values[parameter].clear();
+		append_parameter_value_to(parameter_values[parameter++], table.columns[table.primary_key_columns[n]], prev_key[n]);
+	}
+	for (size_t n = 0; n < last_key.size(); n++) {
+		parameter_values[parameter].clear();
+		append_parameter_value_to(parameter_values[parameter++], table.columns[table.primary_key_columns[n]], last_key[n]);
+	}
+	if (row_count != NO_ROW_COUNT_LIMIT) {
+		parameter_values[parameter].clear();
+		append_integer(parameter_values[parameter++], row_count);
+	}
+
+	parameter_pointers.clear();
+	for (size_t n = 0; n < parameters; n++) {
+		parameter_pointers.push_back(parameter_values[n].c_str());
+	}
+}
+
+void PostgreSQLClient::append_parameter_value_to(string &result, const Column &column, const PackedValueView &value) {
+	// parameter values aren't parsed as literals, so they don't need quoting or escaping, only the input format for their type
+	const uint8_t *string_data;
+	size_t string_length;
+	if (value.raw_bytes(string_data, string_length)) {
+		if (column.column_type == ColumnTypes::BLOB) {
+			append_bytea_input_to(result, string_data, string_length, "\\");
+		} else {
+			result.append((const char *)string_data, string_length);
+		}
+	} else if (value.is_false()) {
+		result += 'f';
+	} else if (value.is_true()) {
+		result += 't';
+	} else {
+		append_encoded(*this, column, value, result);
+	}
 }
 
 void PostgreSQLClient::execute(const string &sql) {
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQpipelineStatus(conn) != PQ_PIPELINE_OFF) {
+		// we'll get the result when sync_pipeline() is called
+		if (!PQsendQueryParams(conn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0)) {
+			throw runtime_error(sql_error(sql));
+		}
+		pipelined_statements.push_back(statement_for_error(sql));
+		return;
+	}
+#endif
+
     PostgreSQLRes res(PQexec(conn, sql.c_str()));
 
     if (res.status() != PGRES_COMMAND_OK && res.status() != PGRES_TUPLES_OK) {
@@ -228,6 +683,72 @@ void PostgreSQLClient::execute(const string &sql) {
     }
 }
 
+void PostgreSQLClient::copy_rows_in(const string &sql, const string &data) {
+	PostgreSQLRes res(PQexec(conn, sql.c_str()));
+
+	if (res.status() != PGRES_COPY_IN) {
+		throw runtime_error(sql_error(sql));
+	}
+
+	// these only fail if the connection has been lost, in which case there's nothing to clean up
+	if (PQputCopyData(conn, data.data(), data.size()) != 1 || PQputCopyEnd(conn, nullptr) != 1) {
+		throw runtime_error(sql_error(sql));
+	}
+
+	// errors in the data are reported once the server has seen the end of it
+	PostgreSQLRes copy_res(PQgetResult(conn));
+	string error;
+	if (copy_res.status() != PGRES_COMMAND_OK) error = sql_error(sql);
+	while (PGresult *extra_result = PQgetResult(conn)) PQclear(extra_result);
+	if (!error.empty()) throw runtime_error(error);
+}
+
+bool PostgreSQLClient::enter_pipeline_mode() {
+#ifdef LIBPQ_HAS_PIPELINING
+	return (PQenterPipelineMode(conn) == 1);
+#else
+	return false; // our libpq is too old; we just execute each statement as it's given to us
+#endif
+}
+
+void PostgreSQLClient::sync_pipeline() {
+#ifdef LIBPQ_HAS_PIPELINING
+	if (!PQpipelineSync(conn)) {
+		throw runtime_error(PQerrorMessage(conn));
+	}
+
+	// each statement's results are followed by a null, and the whole lot by the sync result.  once a statement
+	// fails, the following statements aren't run, and just give aborted results.
+	string error;
+	size_t statement = 0;
+	while (true) {
+		PGresult *result = PQgetResult(conn);
+		if (!result) {
+			if (++statement > pipelined_statements.size()) {
+				// the connection has been lost, so we won't get a sync result
+				if (error.empty()) error = PQerrorMessage(conn);
+				break;
+			}
+			continue;
+		}
+
+		ExecStatusType status = PQresultStatus(result);
+		if (status == PGRES_PIPELINE_SYNC) {
+			PQclear(result);
+			break;
+		}
+		if (error.empty() && status != PGRES_COMMAND_OK && status != PGRES_TUPLES_OK && status != PGRES_PIPELINE_ABORTED) {
+			error = PQresultErrorMessage(result) + string("\n") + (statement < pipelined_statements.size() ? pipelined_statements[statement] : string());
+		}
+		PQclear(result);
+	}
+
+	pipelined_statements.clear();
+	PQexitPipelineMode(conn);
+	if (!error.empty()) throw runtime_error(error);
+#endif
+}
+
 string PostgreSQLClient::select_one(const string &sql) {
 	PostgreSQLRes res(PQexecParams(conn, sql.c_str(), 0, nullptr, nullptr, nullptr, nullptr, 0 /* text-format results only */));
 
@@ -243,11 +764,99 @@ string PostgreSQLClient::select_one(const string &sql) {
 	return PostgreSQLRow(res, 0).string_at(0);
 }
 
+bool PostgreSQLClient::binary_results_supported(const Table &table) {
+	// filter expressions may have any type, which we wouldn't be able to decode
+	for (const Column &column : table.columns) {
+		if (!column.filter_expression.empty()) return false;
+	}
+	return true;
+}
+
+string PostgreSQLClient::binary_select_columns_sql(const Table &table) {
+	// we decode the binary format of the common types ourselves, and have the server convert any others to text,
+	// whose binary format is the same as its text format.  we don't decode floating point values, since the text
+	// the server would give for those depends on its version and extra_float_digits.
+	string result;
+	for (const Column &column : table.columns) {
+		if (!result.empty()) result += ", ";
+		result += '"';
+		result += column.name;
+		result += '"';
+		if (column.column_type == ColumnTypes::REAL ||
+			((column.column_type == ColumnTypes::DATE || column.column_type == ColumnTypes::TIME || column.column_type == ColumnTypes::DTTM) && !binary_datetimes)) {
+			result += "::text";
+		}
+	}
+	return result;
+}
+
+vector<size_t> PostgreSQLClient::binary_copy_packers(const Table &table) {
+	// the packers that binary_column_packer_for_type would choose for the types binary_select_columns_sql gives
+	vector<size_t> result;
+	for (const Column &column : table.columns) {
+		if (column.column_type == ColumnTypes::BOOL) {
+			result.push_back(pack_binary_bool_column);
+		} else if (column.column_type == ColumnTypes::SINT || column.column_type == ColumnTypes::UINT) {
+			result.push_back(column.size == 2 ? pack_binary_int2_column : column.size == 4 ? pack_binary_int4_column : pack_binary_int8_column);
+		} else if (column.column_type == ColumnTypes::DECI) {
+			result.push_back(pack_binary_numeric_column);
+		} else if (column.column_type == ColumnTypes::DATE && binary_datetimes) {
+			result.push_back(pack_binary_date_column);
+		} else if (column.column_type == ColumnTypes::TIME && binary_datetimes) {
+			result.push_back(pack_binary_time_column);
+		} else if (column.column_type == ColumnTypes::DTTM && binary_datetimes) {
+			result.push_back(pack_binary_timestamp_column);
+		} else {
+			result.push_back(pack_raw_column);
+		}
+	}
+	return result;
+}
+
+bool PostgreSQLClient::read_binary_copy_row(PostgreSQLRes &res, const uint8_t *data, size_t length, bool &header_read) {
+	// returns true if the data is a row, which is a count of fields and then the length and value of each; the
+	// first row is preceded by the header, and the last row is followed by a trailer which has a count of -1.
+	const uint8_t *end = data + length;
+
+	if (!header_read) {
+		static const char signature[] = "PGCOPY\n\377\r\n"; // including the terminating nul, 11 bytes
+		if (length < 19 || memcmp(data, signature, 11) != 0) throw runtime_error("Invalid binary COPY header");
+		uint32_t extension_length = binary_uint32_at(data + 15); // after the flags field
+		data += 19;
+		if (extension_length > end - data) throw runtime_error("Invalid binary COPY header");
+		data += extension_length;
+		header_read = true;
+		if (data == end) return false;
+	}
+
+	if (end - data < 2) throw runtime_error("Invalid binary COPY row");
+	int fields = (int16_t)binary_uint16_at(data);
+	data += 2;
+	if (fields == -1) return false;
+	if (fields != res.n_columns()) throw runtime_error("Binary COPY row has " + to_string(fields) + " fields but expected " + to_string(res.n_columns()));
+
+	for (int field = 0; field < fields; field++) {
+		if (end - data < 4) throw runtime_error("Invalid binary COPY row");
+		int32_t field_length = binary_uint32_at(data);
+		data += 4;
+		res.copied_lengths[field] = field_length;
+		if (field_length < 0) continue;
+		if (field_length > end - data) throw runtime_error("Invalid binary COPY row");
+		res.copied_values[field] = (const char *)data;
+		data += field_length;
+	}
+	return true;
+}
+
 string PostgreSQLClient::sql_error(const string &sql) {
+	return PQerrorMessage(conn) + string("\n") + statement_for_error(sql);
+}
+
+string PostgreSQLClient::statement_for_error(const string &sql) {
 	if (sql.size() < 200) {
-		return PQerrorMessage(conn) + string("\n") + sql;
+		return sql;
 	} else {
-		return PQerrorMessage(conn) + string("\n") + sql.substr(0, 200) + "...";
+		return sql.substr(0, 200) + "...";
 	}
 }
 
@@ -286,41 +895,125 @@ void PostgreSQLClient::unhold_snapshot() {
 void PostgreSQLClient::disable_referential_integrity() {
 	execute("SET CONSTRAINTS ALL DEFERRED");
 
-	/* TODO: investigate the pros and cons of disabling triggers - this blocks if there's a read transaction open
-	for (const Table &table : database.tables) {
-		execute("ALTER TABLE " + table.name + " DISABLE TRIGGER ALL");
-	}
-	*/
+	// we don't disable triggers using ALTER TABLE, since that blocks if there's a read transaction open; see
+	// enable_fast_apply for the opt-in alternative
 }
 
 void PostgreSQLClient::enable_referential_integrity() {
-	/* TODO: investigate the pros and cons of disabling triggers - this blocks if there's a read transaction open
-	for (const Table &table : database.tables) {
-		execute("ALTER TABLE " + table.name + " ENABLE TRIGGER ALL");
+}
+
+string PostgreSQLClient::enable_fast_apply(const Database &database) {
+	// in the replica role, triggers don't fire for our session, and that includes the system triggers that check
+	// foreign keys, which would otherwise cost a lookup for every row we change.  this needs superuser privileges
+	// (or on 15+, a grant for the setting), so we report that rather than the bare permission error.
+	try {
+		execute("SET session_replication_role = replica");
+	} catch (const runtime_error &e) {
+		throw runtime_error("--fast-apply needs permission to set session_replication_role on PostgreSQL, which normally requires a superuser\n" + string(e.what()));
 	}
-	*/
+	return "triggers and foreign key checks disabled using session_replication_role";
+}
+
+void PostgreSQLClient::disable_fast_apply() {
+	execute("SET session_replication_role = DEFAULT");
 }
 
 string PostgreSQLClient::escape_value(const string &value) {
 	string result;
-	result.resize(value.size()*2 + 1);
-	size_t result_length = PQescapeStringConn(conn, (char*)result.data(), value.c_str(), value.size(), nullptr);
-	result.resize(result_length);
+	append_escaped_value_to(result, (const uint8_t *)value.data(), value.size());
 	return result;
 }
 
 string PostgreSQLClient::escape_column_value(const Column &column, const string &value) {
+	string result;
+	append_escaped_column_value_to(result, column, (const uint8_t *)value.data(), value.size());
+	return result;
+}
+
+void PostgreSQLClient::append_escaped_value_to(string &result, const uint8_t *value, size_t length) {
+	// escape straight into the end of the statement we're building, rather than into a temporary string
+	size_t start = result.size();
+	result.resize(start + length*2 + 1);
+	size_t result_length = PQescapeStringConn(conn, &result[start], (const char *)value, length, nullptr);
+	result.resize(start + result_length);
+}
+
+static void append_hex_bytes_to(string &result, const uint8_t *value, size_t length) {
+	static const char hex_digits[] = "0123456789abcdef";
+	size_t start = result.size();
+	result.resize(start + length*2);
+	char *dest = &result[start];
+	for (const uint8_t *end = value + length; value != end; value++) {
+		*dest++ = hex_digits[*value >> 4];
+		*dest++ = hex_digits[*value & 0x0f];
+	}
+}
+
+void PostgreSQLClient::append_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length) {
 	if (column.column_type != ColumnTypes::BLOB) {
-		return escape_value(value);
+		append_escaped_value_to(result, value, length);
+
+	} else if (hex_bytea_literals) {
+		// this is exactly what PQescapeByteaConn produces for these servers, but without the malloc and copies
+		result += "\\x";
+		append_hex_bytes_to(result, value, length);
+
+	} else {
+		size_t encoded_length;
+		const unsigned char *encoded = PQescapeByteaConn(conn, value, length, &encoded_length);
+
+		// bizarrely, the bytea parser is an extra level on top of the normal escaping, so you still need the latter after PQescapeByteaConn, even though PQunescapeBytea doesn't do the reverse
+		append_escaped_value_to(result, encoded, encoded_length - 1); // encoded_length includes the terminating null
+		PQfreemem((void *)encoded);
+	}
+}
+
+void PostgreSQLClient::append_bytea_input_to(string &result, const uint8_t *value, size_t length, const char *backslash) {
+	if (hex_bytea_input) {
+		result += backslash;
+		result += 'x';
+		append_hex_bytes_to(result, value, length);
+	} else {
+		// the older escape format
+		for (const uint8_t *end = value + length; value != end; value++) {
+			if (*value >= 0x20 && *value < 0x7f && *value != '\\') {
+				result += (char)*value;
+			} else {
+				result += backslash;
+				result += (char)('0' + (*value >> 6));
+				result += (char)('0' + ((*value >> 3) & 7));
+				result += (char)('0' + (*value & 7));
+			}
+		}
 	}
+}
 
-	size_t encoded_length;
-	const unsigned char *encoded = PQescapeByteaConn(conn, (const unsigned char *)value.c_str(), value.size(), &encoded_length);
-	string result(encoded, encoded + encoded_length);
-	PQfreemem((void *)encoded);
+void PostgreSQLClient::append_copy_escaped_column_value_to(string &result, const Column &column, const uint8_t *value, size_t length) {
+	const uint8_t *end = value + length;
+
+	if (column.column_type == ColumnTypes::BLOB) {
+		// COPY treats backslashes as escapes just like the old string literals, so the bytea input format's
+		// backslashes have to be doubled up
+		append_bytea_input_to(result, value, length, "\\\\");
+		return;
+	}
 
-	// bizarrely, the bytea parser is an extra level on top of the normal escaping, so you still need the latter after PQescapeByteaConn, even though PQunescapeBytea doesn't do the reverse
-	return escape_value(result);
+	// other values only need the characters that COPY uses as delimiters escaped, which are rare, so we copy
+	// everything in between in one go
+	while (value != end) {
+		const uint8_t *run = value;
+		while (value != end && *value != '\\' && *value != '\t' && *value != '\n' && *value != '\r') value++;
+		result.append((const char *)run, value - run);
+		if (value == end) break;
+
+		result += '\\';
+		switch (*value++) {
+			case '\t': result += 't'; break;
+			case '\n': result += 'n'; break;
+			case '\r': result += 'r'; break;
+			default:   result += '\\';
+		}
+	}
 }
 
 void PostgreSQLClient::convert_unsupported_database_schema(Database &database) {
@@ -481,18 +1174,22 @@ string PostgreSQLClient::column_definition(const Table &table, const Column &col
 }
 
 struct PostgreSQLColumnLister {
-	inline PostgreSQLColumnLister(Table &table): table(table) {}
+	inline PostgreSQLColumnLister(TableFinder &tables): tables(tables) {}
 
 	inline void operator()(PostgreSQLRow &row) {
-		string name(row.string_at(0));
-		string db_type(row.string_at(1));
-		bool nullable(row.string_at(2) == "f");
+		Table *found = tables.find(row.string_at(0));
+		if (!found) return; // created since we listed the tables
+		Table &table(*found);
+
+		string name(row.string_at(1));
+		string db_type(row.string_at(2));
+		bool nullable(row.string_at(3) == "f");
 		DefaultType default_type(DefaultType::no_default);
 		string default_value;
 
-		if (row.string_at(3) == "t") {
+		if (row.string_at(4) == "t") {
 			default_type = DefaultType::default_value;
-			default_value = row.string_at(4);
+			default_value = row.string_at(5);
 			if (default_value.length() > 20 &&
 				default_value.substr(0, 9) == "nextval('" &&
 				default_value.substr(default_value.length() - 12, 12) == "'::regclass)") {
@@ -550,30 +1247,36 @@ struct PostgreSQLColumnLister {
 		return result;
 	}
 
-	Table &table;
+	TableFinder &tables;
 };
 
 struct PostgreSQLPrimaryKeyLister {
-	inline PostgreSQLPrimaryKeyLister(Table &table): table(table) {}
+	inline PostgreSQLPrimaryKeyLister(TableFinder &tables): tables(tables) {}
 
 	inline void operator()(PostgreSQLRow &row) {
-		string column_name = row.string_at(0);
-		size_t column_index = table.index_of_column(column_name);
-		table.primary_key_columns.push_back(column_index);
+		Table *table = tables.find(row.string_at(0));
+		if (!table) return; // as for PostgreSQLColumnLister
+		string column_name = row.string_at(1);
+		size_t column_index = table->index_of_column(column_name);
+		table->primary_key_columns.push_back(column_index);
 	}
 
-	Table &table;
+	TableFinder &tables;
 };
 
 struct PostgreSQLKeyLister {
-	inline PostgreSQLKeyLister(Table &table): table(table) {}
+	inline PostgreSQLKeyLister(TableFinder &tables): tables(tables) {}
 
 	inline void operator()(PostgreSQLRow &row) {
-		// if we have no primary key, we might need to use another unique key as a surrogate - see PostgreSQLTableLister below
+		Table *found = tables.find(row.string_at(0));
+		if (!found) return; // as for PostgreSQLColumnLister
+		Table &table(*found);
+
+		// if we have no primary key, we might need to use another unique key as a surrogate - see populate_database_schema below
 		// furthermore this key must have no NULLable columns, as they effectively make the index not unique
-		string key_name = row.string_at(0);
-		bool unique = (row.string_at(1) == "t");
-		string column_name = row.string_at(2);
+		string key_name = row.string_at(1);
+		bool unique = (row.string_at(2) == "t");
+		string column_name = row.string_at(3);
 		size_t column_index = table.index_of_column(column_name);
 		// FUTURE: consider representing collation, index type, partial keys etc.
 
@@ -585,70 +1288,131 @@ struct PostgreSQLKeyLister {
 		if (table.primary_key_columns.empty()) {
 			// if we have no primary key, we might need to use another unique key as a surrogate - see MySQLTableLister below -
 			// but this key must have no NULLable columns, as they effectively make the index not unique
-			bool nullable = (row.string_at(3) == "f");
+			bool nullable = (row.string_at(4) == "f");
 			if (unique && nullable) {
 				// mark this as unusable
-				unique_but_nullable_keys.insert(key_name);
+				unique_but_nullable_keys.insert(make_pair(table.name, key_name));
 			}
 		}
 	}
 
-	Table &table;
-	set<string> unique_but_nullable_keys;
+	TableFinder &tables;
+	set< pair<string, string> > unique_but_nullable_keys;
+};
+
+struct PostgreSQLPartitionLister {
+	inline PostgreSQLPartitionLister(TableFinder &tables): tables(tables) {}
+
+	inline void operator()(PostgreSQLRow &row) {
+		Table *table = tables.find(row.string_at(0));
+		if (!table) return; // as for PostgreSQLColumnLister
+
+		if (row.string_at(3) != "r") {
+			// the partition is itself partitioned; we don't support syncing subpartitions separately, but syncing
+			// the partition as a whole would be no better than syncing the whole table, so leave it as one
+			unpartitioned_tables.insert(table->name);
+		}
+		table->partitions.push_back(Partition(row.string_at(1), row.string_at(2)));
+	}
+
+	TableFinder &tables;
+	set<string> unpartitioned_tables;
 };
 
 struct PostgreSQLTableLister {
-	PostgreSQLTableLister(PostgreSQLClient &client, Database &database): client(client), database(database) {}
+	PostgreSQLTableLister(Database &database): database(database) {}
 
 	void operator()(PostgreSQLRow &row) {
-		Table table(row.string_at(0));
-
-		PostgreSQLColumnLister column_lister(table);
-		client.query(
-			"SELECT attname, format_type(atttypid, atttypmod), attnotnull, atthasdef, pg_get_expr(adbin, adrelid) "
-			  "FROM pg_attribute "
-			  "JOIN pg_class ON attrelid = pg_class.oid "
-			  "JOIN pg_type ON atttypid = pg_type.oid "
-			  "LEFT JOIN pg_attrdef ON adrelid = attrelid AND adnum = attnum "
-			 "WHERE attnum > 0 AND "
-			       "NOT attisdropped AND "
-			       "relname = '" + table.name + "' "
-			 "ORDER BY attnum",
-			column_lister);
-
-		PostgreSQLPrimaryKeyLister primary_key_lister(table);
-		client.query(
-			"SELECT column_name "
-			  "FROM information_schema.table_constraints, "
-			       "information_schema.key_column_usage "
-			 "WHERE information_schema.table_constraints.table_name = '" + table.name + "' AND "
-			       "information_schema.key_column_usage.table_name = information_schema.table_constraints.table_name AND "
-			       "constraint_type = 'PRIMARY KEY' "
-			 "ORDER BY ordinal_position",
-			primary_key_lister);
-
-		PostgreSQLKeyLister key_lister(table);
-		client.query(
-			"SELECT indexname, indisunique, attname, attnotnull "
-			  "FROM (SELECT table_class.oid AS table_oid, index_class.relname AS indexname, pg_index.indisunique, generate_series(1, array_length(indkey, 1)) AS position, unnest(indkey) AS attnum "
-			          "FROM pg_class table_class, pg_class index_class, pg_index "
-			         "WHERE table_class.relname = '" + table.name + "' AND "
-			               "table_class.relkind = 'r' AND "
-			               "index_class.relkind = 'i' AND "
-			               "pg_index.indrelid = table_class.oid AND "
-			               "pg_index.indexrelid = index_class.oid AND "
-			               "NOT pg_index.indisprimary) index_attrs,"
-			       "pg_attribute "
-			 "WHERE pg_attribute.attrelid = table_oid AND "
-			       "pg_attribute.attnum = index_attrs.attnum "
-			 "ORDER BY indexname, index_attrs.position",
-			key_lister);
-
-		// if the table has no primary key, we need to find a unique key with no nullable columns to act as a surrogate primary key
+		database.tables.push_back(Table(row.string_at(0)));
+	}
+
+	Database &database;
+};
+
+void PostgreSQLClient::populate_database_schema(Database &database, bool list_partitions) {
+	// from 10 onwards, the partitions of declaratively partitioned tables are listed as tables themselves; we list
+	// them as partitions of their table instead (see below), unless the other end doesn't know about partitions
+	bool declarative_partitioning = (list_partitions && PQserverVersion(conn) >= 100000);
+
+	PostgreSQLTableLister table_lister(database);
+	query("SELECT tablename "
+		    "FROM pg_tables " +
+		  string(declarative_partitioning ? "JOIN pg_namespace ON nspname = schemaname JOIN pg_class ON relname = tablename AND relnamespace = pg_namespace.oid AND NOT relispartition " : "") +
+		   "WHERE schemaname = ANY (current_schemas(false)) "
+		   "ORDER BY pg_relation_size(tablename::text) DESC, tablename ASC",
+		  table_lister);
+
+	// rather than querying the catalogs for each table in turn, which takes a long time for schemas with thousands
+	// of tables, we list the columns and keys of all the tables at once and then pick them out by name
+	TableFinder tables(database.tables);
+
+	PostgreSQLColumnLister column_lister(tables);
+	query("SELECT relname, attname, format_type(atttypid, atttypmod), attnotnull, atthasdef, pg_get_expr(adbin, adrelid) "
+		    "FROM pg_attribute "
+		    "JOIN pg_class ON attrelid = pg_class.oid "
+		    "JOIN pg_namespace ON relnamespace = pg_namespace.oid "
+		    "JOIN pg_type ON atttypid = pg_type.oid "
+		    "LEFT JOIN pg_attrdef ON adrelid = attrelid AND adnum = attnum "
+		   "WHERE nspname = ANY (current_schemas(false)) AND "
+		         "relkind IN ('r', 'p') AND "
+		         "attnum > 0 AND "
+		         "NOT attisdropped "
+		   "ORDER BY relname, attnum",
+		  column_lister);
+
+	PostgreSQLPrimaryKeyLister primary_key_lister(tables);
+	query("SELECT relname, attname "
+		    "FROM (SELECT indrelid, generate_series(1, array_length(indkey, 1)) AS position, unnest(indkey) AS attnum "
+		            "FROM pg_index "
+		           "WHERE indisprimary) primary_key_attrs "
+		    "JOIN pg_class ON indrelid = pg_class.oid "
+		    "JOIN pg_namespace ON relnamespace = pg_namespace.oid "
+		    "JOIN pg_attribute ON attrelid = indrelid AND pg_attribute.attnum = primary_key_attrs.attnum "
+		   "WHERE nspname = ANY (current_schemas(false)) "
+		   "ORDER BY relname, position",
+		  primary_key_lister);
+
+	PostgreSQLKeyLister key_lister(tables);
+	query("SELECT tablename, indexname, indisunique, attname, attnotnull "
+		    "FROM (SELECT table_class.oid AS table_oid, table_class.relname AS tablename, index_class.relname AS indexname, pg_index.indisunique, generate_series(1, array_length(indkey, 1)) AS position, unnest(indkey) AS attnum "
+		            "FROM pg_class table_class, pg_namespace, pg_class index_class, pg_index "
+		           "WHERE table_class.relnamespace = pg_namespace.oid AND "
+		                 "nspname = ANY (current_schemas(false)) AND "
+		                 "table_class.relkind IN " + string(declarative_partitioning ? "('r', 'p')" : "('r')") + " AND "
+		                 "index_class.relkind IN " + string(declarative_partitioning ? "('i', 'I')" : "('i')") + " AND "
+		                 "pg_index.indrelid = table_class.oid AND "
+		                 "pg_index.indexrelid = index_class.oid AND "
+		                 "NOT pg_index.indisprimary) index_attrs,"
+		         "pg_attribute "
+		   "WHERE pg_attribute.attrelid = table_oid AND "
+		         "pg_attribute.attnum = index_attrs.attnum "
+		   "ORDER BY tablename, indexname, index_attrs.position",
+		  key_lister);
+
+	if (declarative_partitioning) {
+		// each partition can be queried directly by its own name, which we qualify with its schema if necessary
+		PostgreSQLPartitionLister partition_lister(tables);
+		query("SELECT parent_class.relname, partition_class.oid::regclass::text, pg_get_partkeydef(parent_class.oid) || ' ' || pg_get_expr(partition_class.relpartbound, partition_class.oid), partition_class.relkind "
+			    "FROM pg_inherits "
+			    "JOIN pg_class parent_class ON inhparent = parent_class.oid "
+			    "JOIN pg_namespace ON parent_class.relnamespace = pg_namespace.oid "
+			    "JOIN pg_class partition_class ON inhrelid = partition_class.oid "
+			   "WHERE nspname = ANY (current_schemas(false)) AND "
+			         "parent_class.relkind = 'p' "
+			   "ORDER BY parent_class.relname, partition_class.oid::regclass::text",
+			  partition_lister);
+
+		for (const string &table_name : partition_lister.unpartitioned_tables) {
+			tables.find(table_name)->partitions.clear();
+		}
+	}
+
+	for (Table &table : database.tables) {
+		// if the table has no primary key, we need to find a unique key with no nullable columns to act as a surrogate primary key
 		sort(table.keys.begin(), table.keys.end()); // order is arbitrary for keys, but both ends must be consistent, so we sort the keys by name
-		
+
 		for (Keys::const_iterator key = table.keys.begin(); key != table.keys.end() && table.primary_key_columns.empty(); ++key) {
-			if (key->unique && !key_lister.unique_but_nullable_keys.count(key->name)) {
+			if (key->unique && !key_lister.unique_but_nullable_keys.count(make_pair(table.name, key->name))) {
 				table.primary_key_columns = key->columns;
 			}
 		}
@@ -656,21 +1420,7 @@ struct PostgreSQLTableLister {
 			// of course this falls apart if there are no unique keys, so we don't allow that
 			throw runtime_error("Couldn't find a primary or non-nullable unique key on table " + table.name);
 		}
-
-		database.tables.push_back(table);
 	}
-
-	PostgreSQLClient &client;
-	Database &database;
-};
-
-void PostgreSQLClient::populate_database_schema(Database &database) {
-	PostgreSQLTableLister table_lister(*this, database);
-	query("SELECT tablename "
-		    "FROM pg_tables "
-		   "WHERE schemaname = ANY (current_schemas(false)) "
-		   "ORDER BY pg_relation_size(tablename::text) DESC, tablename ASC",
-		  table_lister);
 }
 
 
@@ -0,0 +1,159 @@
+#ifndef MERGE_ROW_RANGE_APPLIER_H
+#define MERGE_ROW_RANGE_APPLIER_H
+
+#include "row_replacer.h"
+#include "key_comparator.h"
+#include "message_pack/flat_row.h"
+#include "rows_decoder.h"
+
+// an alternative to RowRangeApplier for tables whose primary key ordering we know (see KeyComparator).  the
+// source rows arrive in primary key order and we retrieve our rows in the same order, so we can walk through
+// both in step, deciding what to do with each row as soon as we see it, rather than buffering the source rows
+// and looking them up as we retrieve ours.  we only ever hold one batch of our own rows at a time.  we compare
+// the rows by their normalized keys, so that each row's key is only decoded once.
+template <typename DatabaseClient>
+struct MergeRowRangeApplier {
+	static const size_t MAX_ROWS_TO_SELECT = 10000; // as for RowRangeApplier
+	static const size_t MAX_SENSIBLE_INSERT_STATEMENT_SIZE = 4*1024*1024;
+	static const size_t MAX_SENSIBLE_DELETE_STATEMENT_SIZE =     16*1024;
+
+	MergeRowRangeApplier(RowReplacer<DatabaseClient> &replacer, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key):
+		replacer(replacer),
+		client(replacer.client),
+		table(table),
+		comparator(table),
+		source_prev_key(prev_key),
+		local_prev_key(prev_key),
+		last_key(last_key),
+		local_rows_retrieved(0),
+		local_rows_used(0),
+		local_rows_exhausted(false) {
+		if (!prev_key.empty()) comparator.normalize_key_values(prev_key, source_prev_normalized_key);
+	}
+
+	template <typename InputStream>
+	void stream_from_input(Unpacker<InputStream> &input, RowsDecoder &decoder) {
+		while (true) {
+			// as for RowRangeApplier, the rows are terminated by an empty array
+			decoder.read_row(input, source_row);
+			if (source_row.size() == 0) break;
+			received_source_row();
+		}
+
+		received_all_source_rows();
+	}
+
+	void received_source_row() {
+		// everything below relies on the rows being in order, so make sure they are
+		comparator.normalize_key(source_row, source_normalized_key);
+		if (!source_prev_normalized_key.empty() && source_normalized_key <= source_prev_normalized_key) {
+			throw command_error("Rows for " + table.name + " were not received in primary key order");
+		}
+		set_to_primary_key_of(source_prev_key, source_row);
+
+		while (true) {
+			FlatRow *local_row = next_local_row();
+			int comparison = (local_row ? local_normalized_keys[local_rows_used].compare(source_normalized_key) : 1);
+
+			if (comparison < 0) {
+				// we have a row that we shouldn't have, so we need to remove it
+				replacer.remove_row(*local_row);
+				local_rows_used++;
+
+			} else if (comparison == 0) {
+				// we have the row at both ends; if it's changed, we need to replace it
+				if (*local_row != source_row) replacer.replace_row(source_row);
+				local_rows_used++;
+				break;
+
+			} else if (!local_row && last_key.empty()) {
+				// we don't have the row, and we don't have any later rows in the table either, so there's nothing to clear.
+				// if we do have later rows, they may hold the row's unique key values, so it must go through insert_row.
+				replacer.append_row(source_row);
+				break;
+
+			} else {
+				// we don't have the row
+				replacer.insert_row(source_row);
+				break;
+			}
+		}
+
+		// we have no query running at this point, so we can apply the statements built up so far if they're big enough
+		apply_if_necessary();
+
+		source_prev_normalized_key.swap(source_normalized_key);
+	}
+
+	void received_all_source_rows() {
+		// clear any rows after the last source row (within the range we are processing, which may or may not go to the
+		// end of the table); any of our rows in that range that we've already retrieved will be deleted by this too.
+		if (last_key.empty() || source_prev_key != last_key) {
+			string sql("DELETE FROM ");
+			sql += table.name;
+			append_where_sql(client, table, source_prev_key, last_key, sql);
+			client.execute(sql);
+		}
+	}
+
+	FlatRow *next_local_row() {
+		if (local_rows_used == local_rows_retrieved) {
+			if (local_rows_exhausted) return nullptr;
+
+			// retrieve the next batch of our rows; we can't run other statements while a query is returning results, so
+			// we retrieve a limited number at a time and pick up after the last one we retrieved each time
+			local_rows_retrieved = local_rows_used = 0;
+			if (client.retrieve_rows(*this, table, local_prev_key, last_key, MAX_ROWS_TO_SELECT) < MAX_ROWS_TO_SELECT) {
+				local_rows_exhausted = true;
+			}
+			if (!local_rows_retrieved) return nullptr;
+			set_to_primary_key_of(local_prev_key, local_rows[local_rows_retrieved - 1]);
+		}
+		return &local_rows[local_rows_used];
+	}
+
+	void operator()(const typename DatabaseClient::RowType &database_row) {
+		// reuse the rows from the previous batch to avoid reallocating their buffers
+		if (local_rows_retrieved == local_rows.size()) {
+			local_rows.emplace_back();
+			local_normalized_keys.emplace_back();
+		}
+		FlatRow &local_row(local_rows[local_rows_retrieved]);
+		local_row.clear();
+		database_row.pack_row_into(local_row);
+		comparator.normalize_key(local_row, local_normalized_keys[local_rows_retrieved]);
+		local_rows_retrieved++;
+	}
+
+	void set_to_primary_key_of(ColumnValues &key, const FlatRow &row) {
+		key.resize(table.primary_key_columns.size());
+		for (size_t n = 0; n < table.primary_key_columns.size(); n++) {
+			key[n] = row[table.primary_key_columns[n]];
+		}
+	}
+
+	inline void apply_if_necessary() {
+		if (replacer.insert_size() > MAX_SENSIBLE_INSERT_STATEMENT_SIZE ||
+			replacer.primary_key_clearer.delete_sql.curr.size() > MAX_SENSIBLE_DELETE_STATEMENT_SIZE) {
+			replacer.apply();
+		}
+	}
+
+	RowReplacer<DatabaseClient> &replacer;
+	DatabaseClient &client;
+	const Table &table;
+	KeyComparator comparator;
+	ColumnValues source_prev_key;
+	ColumnValues local_prev_key;
+	ColumnValues last_key;
+	FlatRow source_row;
+	string source_normalized_key;
+	string source_prev_normalized_key;
+	vector<FlatRow> local_rows;
+	vector<string> local_normalized_keys;
+	size_t local_rows_retrieved;
+	size_t local_rows_used;
+	bool local_rows_exhausted;
+};
+
+#endif
@@ -14,6 +14,15 @@ uint8_t *copy_bytes(Unpacker<Stream> &unpacker, PackedValue &obj, size_t bytes)
 
 template <typename Stream>
 void copy_object(Unpacker<Stream> &unpacker, PackedValue &obj) {
+	// if the whole value is already buffered, copy it in one go
+	size_t bytes_available, length;
+	const uint8_t *data = unpacker.peek(bytes_available);
+	if (scan_packed_values(data, bytes_available, 1, length)) {
+		obj.write(data, length);
+		unpacker.skip_bytes(length);
+		return;
+	}
+
 	uint8_t leader = *copy_bytes(unpacker, obj, 1);
 
 	if ((leader == MSGPACK_NIL || leader == MSGPACK_FALSE || leader == MSGPACK_TRUE) ||
@@ -132,14 +141,24 @@ Packer<Stream> &operator <<(Packer<Stream> &packer, const PackedValue &obj) {
 }
 
 struct VectorReadStream {
-	inline VectorReadStream(const PackedValue &value): value(value), pos(0) {}
+	inline VectorReadStream(const PackedValueView &value): data(value.data()), size(value.size()), pos(0) {}
 
 	inline void read(uint8_t *dest, size_t bytes) {
-		memcpy(dest, value.data() + pos, bytes);
+		memcpy(dest, data + pos, bytes);
+		pos += bytes;
+	}
+
+	inline const uint8_t *peek(size_t &bytes_available) {
+		bytes_available = size - pos;
+		return data + pos;
+	}
+
+	inline void skip(size_t bytes) {
 		pos += bytes;
 	}
 
-	const PackedValue &value;
+	const uint8_t *data;
+	size_t size;
 	size_t pos;
 };
 
@@ -0,0 +1,126 @@
+#ifndef FLAT_ROW_H
+#define FLAT_ROW_H
+
+#include <vector>
+#include "copy_packed.h"
+
+// refers to a row held elsewhere in the same layout as a FlatRow, for example a copy made in an Arena
+struct FlatRowView {
+	FlatRowView(): encoded(nullptr), encoded_bytes(0), column_offsets(nullptr), columns(0) {}
+	FlatRowView(const uint8_t *encoded, size_t encoded_bytes, const uint32_t *column_offsets, size_t columns): encoded(encoded), encoded_bytes(encoded_bytes), column_offsets(column_offsets), columns(columns) {}
+
+	inline size_t size() const { return columns; }
+	inline bool empty() const { return !columns; }
+
+	inline PackedValueView operator[](size_t column_number) const {
+		size_t start = column_offsets[column_number];
+		size_t end = (column_number + 1 < columns ? column_offsets[column_number + 1] : encoded_bytes);
+		return PackedValueView(encoded + start, end - start);
+	}
+
+	inline size_t encoded_size() const { return encoded_bytes; }
+
+	inline bool operator == (const FlatRowView &other) const {
+		// since the values are packed contiguously, rows with the same values have the same offsets
+		return (columns == other.columns && encoded_bytes == other.encoded_bytes && memcmp(encoded, other.encoded, encoded_bytes) == 0);
+	}
+
+	inline bool operator != (const FlatRowView &other) const {
+		return !(*this == other);
+	}
+
+	const uint8_t *encoded;
+	size_t encoded_bytes;
+	const uint32_t *column_offsets;
+	size_t columns;
+};
+
+// holds a whole row in a single buffer of packed values, with the offset at which each column's value starts,
+// so that storing a row costs a couple of allocations rather than one per column; the columns are accessed as
+// views into the buffer.  can be unpacked from a packed array or packed into from a database row.
+struct FlatRow {
+	inline size_t size() const { return column_offsets.size(); }
+	inline bool empty() const { return column_offsets.empty(); }
+
+	inline PackedValueView operator[](size_t column_number) const {
+		return view()[column_number];
+	}
+
+	inline FlatRowView view() const {
+		return FlatRowView(encoded.data(), encoded.size(), column_offsets.data(), column_offsets.size());
+	}
+
+	// the total size of the packed values, not counting the array header that a PackedRow would be sent with
+	inline size_t encoded_size() const { return encoded.size(); }
+
+	inline void clear() {
+		encoded.clear();
+		column_offsets.clear();
+	}
+
+	inline void reserve(size_t columns) {
+		column_offsets.reserve(columns);
+	}
+
+	// call before appending each column's value to encoded
+	inline void start_column() {
+		column_offsets.push_back(encoded.size());
+	}
+
+	inline bool operator == (const FlatRow &other) const {
+		return (view() == other.view());
+	}
+
+	inline bool operator != (const FlatRow &other) const {
+		return !(*this == other);
+	}
+
+	PackedValue encoded;
+	std::vector<uint32_t> column_offsets;
+};
+
+template <typename Stream>
+Unpacker<Stream> &operator >>(Unpacker<Stream> &unpacker, FlatRow &row) {
+	// if the whole row is already buffered, find where its columns start and take it in a single slice
+	size_t bytes_available, columns, header_length, length;
+	const uint8_t *data = unpacker.peek(bytes_available);
+	if (scan_packed_array_header(data, bytes_available, columns, header_length)) {
+		row.column_offsets.resize(columns);
+		if (scan_packed_values(data + header_length, bytes_available - header_length, columns, length, row.column_offsets.data())) {
+			row.encoded.clear();
+			row.encoded.write(data + header_length, length);
+			unpacker.skip_bytes(header_length + length);
+			return unpacker;
+		}
+	}
+
+	columns = unpacker.next_array_length();
+	row.clear();
+	row.reserve(columns);
+	while (columns--) {
+		row.start_column();
+		copy_object(unpacker, row.encoded);
+	}
+	return unpacker;
+}
+
+template <typename Stream>
+Packer<Stream> &operator <<(Packer<Stream> &packer, const FlatRow &row) {
+	pack_array_length(packer, row.size());
+	packer.write_bytes(row.encoded.data(), row.encoded.size());
+	return packer;
+}
+
+// lets database rows pack themselves into a FlatRow in the same way as a PackedRow
+template <typename T>
+inline FlatRow &operator <<(FlatRow &row, const T &obj) {
+	row.start_column();
+	row.encoded << obj;
+	return row;
+}
+
+inline void pack_array_length(FlatRow &row, size_t size) {
+	row.reserve(size);
+}
+
+#endif
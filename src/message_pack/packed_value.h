@@ -4,60 +4,109 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdexcept>
+#include <algorithm>
+#include <new>
 #include "type_codes.h"
 
+// refers to a packed value stored elsewhere, such as one of the columns of a FlatRow
+struct PackedValueView {
+	PackedValueView(const uint8_t *encoded_bytes, size_t used): encoded_bytes(encoded_bytes), used(used) {}
+
+	inline bool empty() const { return !used; }
+	inline size_t size() const { return used; }
+	inline uint8_t leader() const { return (used ? *encoded_bytes : 0); }
+	inline const uint8_t *data() const { return encoded_bytes; }
+
+	inline bool is_nil()   const { return (leader() == MSGPACK_NIL); }
+	inline bool is_false() const { return (leader() == MSGPACK_FALSE); }
+	inline bool is_true()  const { return (leader() == MSGPACK_TRUE); }
+
+	// if the value is a string, points data at its bytes (which are not copied) and returns true
+	inline bool raw_bytes(const uint8_t *&data, size_t &length) const {
+		uint8_t leader_byte = leader();
+		size_t header_length;
+		if (leader_byte >= MSGPACK_FIXRAW_MIN && leader_byte <= MSGPACK_FIXRAW_MAX) {
+			header_length = 1;
+		} else if (leader_byte == MSGPACK_RAW16) {
+			header_length = 3;
+		} else if (leader_byte == MSGPACK_RAW32) {
+			header_length = 5;
+		} else {
+			return false;
+		}
+		data = encoded_bytes + header_length;
+		length = used - header_length;
+		return true;
+	}
+
+	inline bool operator == (const PackedValueView &other) const {
+		return (used == other.used && memcmp(encoded_bytes, other.encoded_bytes, used) == 0);
+	}
+
+	inline bool operator != (const PackedValueView &other) const {
+		return !(*this == other);
+	}
+
+	const uint8_t *encoded_bytes;
+	size_t used;
+};
+
+// most values are integers, booleans, nils or short strings, so we store values of up to INLINE_CAPACITY bytes
+// in the object itself rather than on the heap; bigger values fall back to a heap buffer, which we grow
+// geometrically and keep when cleared, since values are often reused to unpack a series of similar values.
 struct PackedValue {
-	PackedValue(): encoded_bytes(NULL), used(0) {}
+	static const size_t INLINE_CAPACITY = 24;
+
+	PackedValue(): encoded_bytes(inline_bytes), used(0), allocated(INLINE_CAPACITY) {}
 
 	~PackedValue() {
-		free(encoded_bytes);
+		if (on_heap()) free(encoded_bytes);
 	}
 
-	PackedValue(const PackedValue &from): encoded_bytes(NULL) {
+	PackedValue(const PackedValue &from): encoded_bytes(inline_bytes), used(0), allocated(INLINE_CAPACITY) {
 		*this = from;
 	}
 
-	PackedValue(PackedValue &&from): encoded_bytes(NULL) {
+	PackedValue(PackedValue &&from) noexcept: encoded_bytes(inline_bytes), used(0), allocated(INLINE_CAPACITY) {
 		*this = std::move(from);
 	}
 
 	PackedValue &operator=(const PackedValue &from) {
 		if (&from != this) {
-			free(encoded_bytes);
-			encoded_bytes = NULL;
-			used = from.used;
-			if (used) {
-				encoded_bytes = (uint8_t *)malloc(used);
-				if (!encoded_bytes) throw std::bad_alloc();
-				memcpy(encoded_bytes, from.encoded_bytes, used);
-			}
+			used = 0;
+			write(from.encoded_bytes, from.used);
 		}
 		return *this;
 	}
 
-	PackedValue &operator=(PackedValue &&from) {
+	PackedValue &operator=(PackedValue &&from) noexcept {
 		if (this != &from) {
-			free(encoded_bytes);
-			used = from.used;
-			encoded_bytes = from.encoded_bytes;
-			from.encoded_bytes = NULL;
+			if (from.on_heap()) {
+				// take their heap buffer
+				if (on_heap()) free(encoded_bytes);
+				encoded_bytes = from.encoded_bytes;
+				used = from.used;
+				allocated = from.allocated;
+				from.encoded_bytes = from.inline_bytes;
+				from.allocated = INLINE_CAPACITY;
+			} else {
+				// their value is small enough that copying it is as cheap as anything else, and it always fits
+				memcpy(encoded_bytes, from.encoded_bytes, from.used);
+				used = from.used;
+			}
 			from.used = 0;
 		}
 		return *this;
 	}
 
 	inline uint8_t *extend(size_t bytes) {
-		uint8_t *new_encoded_bytes = (uint8_t *)realloc(encoded_bytes, used + bytes);
-		if (!new_encoded_bytes) throw std::bad_alloc();
+		if (used + bytes > allocated) grow(used + bytes);
 		size_t size_before = used;
 		used += bytes;
-		encoded_bytes = new_encoded_bytes;
 		return encoded_bytes + size_before;
 	}
 
 	inline void clear() {
-		free(encoded_bytes);
-		encoded_bytes = NULL;
 		used = 0;
 	}
 
@@ -65,6 +114,11 @@ struct PackedValue {
 		memcpy(extend(bytes), src, bytes);
 	}
 
+	// drops the bytes after the first size bytes; keeps the buffer, like clear()
+	inline void truncate(size_t size) {
+		if (size < used) used = size;
+	}
+
 	inline bool empty() const { return !used; }
 	inline size_t size() const { return used; }
 	inline uint8_t leader() const { return (used ? *encoded_bytes : 0); }
@@ -74,6 +128,14 @@ struct PackedValue {
 	inline bool is_false() const { return (leader() == MSGPACK_FALSE); }
 	inline bool is_true()  const { return (leader() == MSGPACK_TRUE); }
 
+	inline operator PackedValueView() const { return PackedValueView(encoded_bytes, used); }
+
+	inline PackedValue &operator=(const PackedValueView &from) {
+		used = 0;
+		write(from.data(), from.size());
+		return *this;
+	}
+
 	inline bool operator == (const PackedValue &other) const {
 		return (used == other.used && memcmp(encoded_bytes, other.encoded_bytes, used) == 0);
 	}
@@ -84,8 +146,27 @@ struct PackedValue {
 	}
 
 protected:
-	uint8_t *encoded_bytes;
+	inline bool on_heap() const { return (encoded_bytes != inline_bytes); }
+
+	void grow(size_t required) {
+		size_t new_allocated = std::max(required, allocated*2);
+		uint8_t *new_encoded_bytes;
+		if (on_heap()) {
+			new_encoded_bytes = (uint8_t *)realloc(encoded_bytes, new_allocated);
+			if (!new_encoded_bytes) throw std::bad_alloc();
+		} else {
+			new_encoded_bytes = (uint8_t *)malloc(new_allocated);
+			if (!new_encoded_bytes) throw std::bad_alloc();
+			memcpy(new_encoded_bytes, inline_bytes, used);
+		}
+		encoded_bytes = new_encoded_bytes;
+		allocated = new_allocated;
+	}
+
+	uint8_t *encoded_bytes; // points to inline_bytes unless the value has outgrown it
 	size_t used;
+	size_t allocated;
+	uint8_t inline_bytes[INLINE_CAPACITY];
 };
 
 #endif
@@ -0,0 +1,181 @@
+#ifndef SCAN_PACKED_H
+#define SCAN_PACKED_H
+
+#include <cstdint>
+#include <cstring>
+#include "endian.h"
+#include "type_codes.h"
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+// unpacking a value one leader byte at a time means a call into the stream for every byte or two, which
+// dominates the cost of reading rows.  instead, when the stream already has the whole value buffered, we find
+// where it ends (and where each of its top-level values start) in one pass over the buffer, and then copy it
+// out in a single slice.  this only finds the boundaries; anything that isn't valid is left for the normal
+// unpacking code to report, by returning false as if the value didn't fit.
+
+inline uint16_t scanned_uint16(const uint8_t *data) {
+	uint16_t value;
+	memcpy(&value, data, sizeof(value));
+	return ntohs(value);
+}
+
+inline uint32_t scanned_uint32(const uint8_t *data) {
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return ntohl(value);
+}
+
+#ifdef __SSE2__
+// returns the number of values at the start of the 16 bytes at data that are encoded as a single byte (fixnums,
+// nil, true and false), which are the commonest values by far in typical rows and keys
+inline size_t single_byte_values_run(const uint8_t *data) {
+	__m128i bytes = _mm_loadu_si128((const __m128i *)data);
+	__m128i fixnums = _mm_cmpgt_epi8(bytes, _mm_set1_epi8((char)(MSGPACK_NEGATIVE_FIXNUM_MIN - 1))); // signed, so both positive and negative fixnums
+	__m128i nils = _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)MSGPACK_NIL));
+	__m128i falses = _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)MSGPACK_FALSE));
+	__m128i trues = _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)MSGPACK_TRUE));
+	unsigned int mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(fixnums, nils), _mm_or_si128(falses, trues)));
+	return __builtin_ctz(~mask); // mask only has 16 bits, so ~mask always has a bit set
+}
+#endif
+
+// scans the count values packed at data, which has available bytes, and returns true and sets length to the
+// number of bytes they take if they are all present.  if starts is given, the offset at which each of the
+// values begins is stored in it.
+inline bool scan_packed_values(const uint8_t *data, size_t available, size_t count, size_t &length, uint32_t *starts = nullptr) {
+	size_t pos = 0;
+	size_t values = 0; // top-level values started
+	size_t nested = 0; // values inside the current top-level value that we haven't reached yet
+
+	while (values < count || nested) {
+#ifdef __SSE2__
+		if (available - pos >= 16) {
+			size_t run = single_byte_values_run(data + pos);
+			if (run) {
+				if (nested) {
+					if (run > nested) run = nested;
+					nested -= run;
+				} else {
+					if (run > count - values) run = count - values;
+					if (starts) {
+						for (size_t n = 0; n < run; n++) starts[values + n] = pos + n;
+					}
+					values += run;
+				}
+				pos += run;
+				continue;
+			}
+		}
+#endif
+		if (pos >= available) return false;
+
+		if (nested) {
+			nested--;
+		} else {
+			if (starts) starts[values] = pos;
+			values++;
+		}
+
+		uint8_t leader = data[pos++];
+		size_t payload = 0, children = 0;
+
+		if ((leader >= MSGPACK_POSITIVE_FIXNUM_MIN && leader <= MSGPACK_POSITIVE_FIXNUM_MAX) ||
+			(leader >= MSGPACK_NEGATIVE_FIXNUM_MIN && leader <= MSGPACK_NEGATIVE_FIXNUM_MAX) ||
+			leader == MSGPACK_NIL || leader == MSGPACK_FALSE || leader == MSGPACK_TRUE) {
+			// no payload
+
+		} else if (leader >= MSGPACK_FIXRAW_MIN && leader <= MSGPACK_FIXRAW_MAX) {
+			payload = (leader & 31);
+
+		} else if (leader >= MSGPACK_FIXARRAY_MIN && leader <= MSGPACK_FIXARRAY_MAX) {
+			children = (leader & 15);
+
+		} else if (leader >= MSGPACK_FIXMAP_MIN && leader <= MSGPACK_FIXMAP_MAX) {
+			children = 2*(leader & 15);
+
+		} else {
+			switch (leader) {
+				case MSGPACK_UINT8:
+				case MSGPACK_INT8:
+					payload = 1;
+					break;
+
+				case MSGPACK_UINT16:
+				case MSGPACK_INT16:
+					payload = 2;
+					break;
+
+				case MSGPACK_FLOAT:
+				case MSGPACK_UINT32:
+				case MSGPACK_INT32:
+					payload = 4;
+					break;
+
+				case MSGPACK_DOUBLE:
+				case MSGPACK_UINT64:
+				case MSGPACK_INT64:
+					payload = 8;
+					break;
+
+				case MSGPACK_RAW16:
+				case MSGPACK_ARRAY16:
+				case MSGPACK_MAP16:
+					if (available - pos < 2) return false;
+					children = scanned_uint16(data + pos);
+					payload = 2;
+					break;
+
+				case MSGPACK_RAW32:
+				case MSGPACK_ARRAY32:
+				case MSGPACK_MAP32:
+					if (available - pos < 4) return false;
+					children = scanned_uint32(data + pos);
+					payload = 4;
+					break;
+
+				default:
+					return false;
+			}
+
+			if (leader == MSGPACK_RAW16 || leader == MSGPACK_RAW32) {
+				payload += children;
+				children = 0;
+			} else if (leader == MSGPACK_MAP16 || leader == MSGPACK_MAP32) {
+				children *= 2;
+			}
+		}
+
+		if (payload > available - pos) return false;
+		pos += payload;
+		nested += children;
+	}
+
+	length = pos;
+	return true;
+}
+
+// if the array header at data is all present, returns true and sets size to the number of elements and
+// header_length to the number of bytes it takes
+inline bool scan_packed_array_header(const uint8_t *data, size_t available, size_t &size, size_t &header_length) {
+	if (!available) return false;
+	uint8_t leader = *data;
+
+	if (leader >= MSGPACK_FIXARRAY_MIN && leader <= MSGPACK_FIXARRAY_MAX) {
+		size = (leader & 15);
+		header_length = 1;
+	} else if (leader == MSGPACK_ARRAY16 && available >= 3) {
+		size = scanned_uint16(data + 1);
+		header_length = 3;
+	} else if (leader == MSGPACK_ARRAY32 && available >= 5) {
+		size = scanned_uint32(data + 1);
+		header_length = 5;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <typeinfo>
 #include "endian.h"
 #include "type_codes.h"
+#include "scan_packed.h"
 #include "../to_string.h"
 #include "../backtrace.h"
 
@@ -87,8 +88,25 @@ public:
 		stream.read(buf, bytes);
 	}
 
+	// returns the bytes that the stream has already buffered, reading more first if it has none, so that values
+	// can be scanned directly in the buffer and then consumed using skip_bytes
+	inline const uint8_t *peek(size_t &bytes_available) {
+		return stream.peek(bytes_available);
+	}
+
+	inline void skip_bytes(size_t bytes) {
+		stream.skip(bytes);
+	}
+
 	// skips the next element in the stream, irrespective of type
 	inline void skip() {
+		size_t bytes_available, length;
+		const uint8_t *data = peek(bytes_available);
+		if (scan_packed_values(data, bytes_available, 1, length)) {
+			skip_bytes(length);
+			return;
+		}
+
 		uint8_t leader = read_bytes<uint8_t>();
 
 		if ((leader >= MSGPACK_POSITIVE_FIXNUM_MIN && leader <= MSGPACK_POSITIVE_FIXNUM_MAX) ||
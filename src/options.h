@@ -6,11 +6,12 @@
 #include <stdexcept>
 #include "commit_level.h"
 #include "hash_algorithm.h"
+#include "rows_encoding.h"
 #include "db_url.h"
 
 struct Options {
-	inline Options(): workers(1), verbose(0), progress(false), snapshot(true), alter(false), structure_only(false),
-    commit_level(CommitLevel::success), hash_algorithm(HashAlgorithm::md5) {}
+	inline Options(): workers(1), verbose(0), progress(false), snapshot(true), alter(false), structure_only(false), shared_memory(true), fast_apply(false),
+    commit_level(CommitLevel::success), hash_algorithm(HashAlgorithm::md5), rows_encoding(RowsEncoding::dictionary) {}
 
 	void help() {
 		cerr <<
@@ -68,6 +69,12 @@ struct Options {
 			"                             committed while the workers are starting (changes\n"
 			"                             after that point won't be a problem anyway).\n"
 			"\n"
+			"  --without-shared-memory    Use pipes rather than shared memory to transfer data\n"
+			"                             between the 'from' and 'to' ends when they are both\n"
+			"                             run on this machine (ie. when --via is not used).\n"
+			"                             Shared memory is faster, but is only supported on\n"
+			"                             Linux.\n"
+			"\n"
 			"  --commit                   When to commit the write transactions.  May be:\n"
 			"                               'never' (roll back after syncing);\n"
 			"                               'success' (commit if all workers complete normally);\n"
@@ -82,12 +89,29 @@ struct Options {
 			"                             and if it doesn't match the statements --alter\n"
 			"                             would use are printed as suggestions.)"
 			"\n"
+			"  --fast-apply               Change settings at the 'to' end that make applying\n"
+			"                             changes faster but make it unsafe to change the\n"
+			"                             tables at the same time.  On PostgreSQL, this turns\n"
+			"                             off triggers, including foreign key checks, using\n"
+			"                             session_replication_role, which normally needs a\n"
+			"                             superuser.  On MySQL, this turns off unique checks\n"
+			"                             if no table has unique keys other than its primary\n"
+			"                             key.  Be careful with --only and --ignore, as the\n"
+			"                             foreign keys to other tables won't be checked.\n"
+			"\n"
 			"  --hash arg                 Use the specified checksum algorithm.  The default\n"
 			"                             is MD5.  You can downgrade to XXH64 if you are more\n"
 			"                             interested in performance than data integrity.\n"
 			"                             This is not considered appropriate for production\n"
 			"                             use, but may be useful for dev/test machines.\n"
 			"\n"
+			"  --rows-encoding arg        How to send the rows that need to be changed.  The\n"
+			"                             default is 'dictionary', which sends strings that\n"
+			"                             are repeated in the same block as references.\n"
+			"                             'columnar' sends batches of rows a column at a time,\n"
+			"                             which usually compresses better.  'plain' sends each\n"
+			"                             row as it is.\n"
+			"\n"
 			"  --from-path                Directory in which to find the Kitchen Sync binaries\n"
 			"                             on the source end.  Normally you should not need this\n"
 			"                             but if you use the --via option and the binaries are\n"
@@ -120,9 +144,12 @@ struct Options {
 					{ "set-from-variables",			required_argument,	NULL,	'F' },
 					{ "set-to-variables",			required_argument,	NULL,	'T' },
 					{ "without-snapshot-export",	no_argument,		NULL,	'W' },
+					{ "without-shared-memory",		no_argument,		NULL,	'M' },
 					{ "commit",						required_argument,	NULL,	'c' },
 					{ "alter",						no_argument,		NULL,	'a' },
+					{ "fast-apply",					no_argument,		NULL,	'A' },
 					{ "hash",					    required_argument,	NULL,	'h' },
+					{ "rows-encoding",				required_argument,	NULL,	'e' },
 					{ "verbose",					no_argument,		NULL,	'V' },
 					{ "progress",					no_argument,		NULL,	'p' },
 					{ "debug",						no_argument,		NULL,	'd' },
@@ -187,6 +214,10 @@ struct Options {
 						snapshot = false;
 						break;
 
+					case 'M':
+						shared_memory = false;
+						break;
+
 					case 'c':
 						if (!strcmp(optarg, "never")) {
 							commit_level = CommitLevel::never;
@@ -205,6 +236,10 @@ struct Options {
 						alter = true;
 						break;
 
+					case 'A':
+						fast_apply = true;
+						break;
+
 					case 'h':
 						if (!strcmp(optarg, "MD5")) {
 							hash_algorithm = HashAlgorithm::md5;
@@ -213,6 +248,19 @@ struct Options {
 						} else {
 							throw invalid_argument("Unknown hash algorithm: " + string(optarg));
 						}
+						break;
+
+					case 'e':
+						if (!strcmp(optarg, "plain")) {
+							rows_encoding = RowsEncoding::plain;
+						} else if (!strcmp(optarg, "dictionary")) {
+							rows_encoding = RowsEncoding::dictionary;
+						} else if (!strcmp(optarg, "columnar")) {
+							rows_encoding = RowsEncoding::columnar;
+						} else {
+							throw invalid_argument("Unknown rows encoding: " + string(optarg));
+						}
+						break;
 
 					case 'V':
 						verbose = 1;
@@ -256,9 +304,12 @@ struct Options {
 	bool progress;
 	bool snapshot;
 	bool alter;
+	bool structure_only;
+	bool shared_memory;
+	bool fast_apply;
 	CommitLevel commit_level;
 	HashAlgorithm hash_algorithm;
-	bool structure_only;
+	RowsEncoding rows_encoding;
 	string ignore, only;
 };
 
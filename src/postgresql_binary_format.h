@@ -0,0 +1,150 @@
+#ifndef POSTGRESQL_BINARY_FORMAT_H
+#define POSTGRESQL_BINARY_FORMAT_H
+
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include "message_pack/endian.h"
+
+using namespace std;
+
+// the binary formats of numeric and the date/time types are converted to the same text that the server would
+// have given us for text-format results (using the ISO DateStyle), so that hashes don't depend on which we used.
+inline uint16_t binary_uint16_at(const uint8_t *data) { uint16_t value; memcpy(&value, data, sizeof(value)); return ntohs(value); }
+inline uint32_t binary_uint32_at(const uint8_t *data) { uint32_t value; memcpy(&value, data, sizeof(value)); return ntohl(value); }
+inline uint64_t binary_uint64_at(const uint8_t *data) { uint64_t value; memcpy(&value, data, sizeof(value)); return ntohll(value); }
+
+inline void append_digits(string &result, unsigned int value, int width) {
+	char digits[10];
+	int length = 0;
+	do {
+		digits[length++] = '0' + value % 10;
+		value /= 10;
+	} while (value || length < width);
+	while (length) result += digits[--length];
+}
+
+// numeric values are sent as a count of base-10000 digits, the weight of the first digit, the sign, the number of
+// decimal places to show, and the digits themselves; this follows numeric_out.
+inline void append_binary_numeric(string &result, const uint8_t *data, size_t length) {
+	if (length < 8) throw runtime_error("Invalid binary numeric value");
+	int ndigits = (int16_t)binary_uint16_at(data);
+	int weight = (int16_t)binary_uint16_at(data + 2);
+	uint16_t sign = binary_uint16_at(data + 4);
+	int dscale = binary_uint16_at(data + 6);
+	if (length < 8 + 2*(size_t)max(ndigits, 0)) throw runtime_error("Invalid binary numeric value");
+	const uint8_t *digits = data + 8;
+	#define NUMERIC_DIGIT(n) ((n) >= 0 && (n) < ndigits ? binary_uint16_at(digits + 2*(n)) : 0)
+
+	switch (sign) {
+		case 0xc000: result += "NaN"; return;
+		case 0xd000: result += "Infinity"; return;
+		case 0xf000: result += "-Infinity"; return;
+		case 0x4000: result += '-'; break;
+	}
+
+	int d = 0;
+	if (weight < 0) {
+		result += '0';
+	} else {
+		for (; d <= weight; d++) {
+			append_digits(result, NUMERIC_DIGIT(d), d == 0 ? 1 : 4);
+		}
+	}
+
+	if (dscale > 0) {
+		result += '.';
+		size_t end = result.size() + dscale;
+		for (d = weight + 1; result.size() < end; d++) {
+			append_digits(result, NUMERIC_DIGIT(d), 4);
+		}
+		result.resize(end);
+	}
+	#undef NUMERIC_DIGIT
+}
+
+// dates are sent as the number of days since 2000-01-01, and times as microseconds
+const int64_t POSTGRES_EPOCH_DAYS_FROM_CIVIL_EPOCH = 10957; // 1970-01-01 to 2000-01-01
+const int64_t MICROSECONDS_PER_DAY = 86400000000LL;
+
+inline void append_binary_days(string &result, int64_t days, bool &bc) {
+	// proleptic gregorian calendar, as postgresql uses; see http://howardhinnant.github.io/date_algorithms.html
+	int64_t z = days + POSTGRES_EPOCH_DAYS_FROM_CIVIL_EPOCH + 719468;
+	int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	int64_t day_of_era = z - era*146097;
+	int64_t year_of_era = (day_of_era - day_of_era/1460 + day_of_era/36524 - day_of_era/146096) / 365;
+	int64_t day_of_year = day_of_era - (365*year_of_era + year_of_era/4 - year_of_era/100);
+	int64_t month_index = (5*day_of_year + 2)/153;
+	int64_t day = day_of_year - (153*month_index + 2)/5 + 1;
+	int64_t month = (month_index < 10 ? month_index + 3 : month_index - 9);
+	int64_t year = year_of_era + era*400 + (month <= 2);
+
+	bc = (year <= 0); // there's no year 0; 1 BC comes before 1 AD
+	append_digits(result, bc ? 1 - year : year, 4);
+	result += '-';
+	append_digits(result, month, 2);
+	result += '-';
+	append_digits(result, day, 2);
+}
+
+inline void append_binary_time_of_day(string &result, int64_t microseconds) {
+	append_digits(result, microseconds/3600000000LL, 2);
+	result += ':';
+	append_digits(result, microseconds/60000000 % 60, 2);
+	result += ':';
+	append_digits(result, microseconds/1000000 % 60, 2);
+	unsigned int fraction = microseconds % 1000000;
+	if (fraction) {
+		int width = 6;
+		while (fraction % 10 == 0) {
+			fraction /= 10;
+			width--;
+		}
+		result += '.';
+		append_digits(result, fraction, width);
+	}
+}
+
+inline void append_binary_date(string &result, const uint8_t *data, size_t length) {
+	if (length != 4) throw runtime_error("Invalid binary date value");
+	int32_t days = binary_uint32_at(data);
+	if (days == INT32_MIN) {
+		result += "-infinity";
+	} else if (days == INT32_MAX) {
+		result += "infinity";
+	} else {
+		bool bc;
+		append_binary_days(result, days, bc);
+		if (bc) result += " BC";
+	}
+}
+
+inline void append_binary_time(string &result, const uint8_t *data, size_t length) {
+	if (length != 8) throw runtime_error("Invalid binary time value");
+	append_binary_time_of_day(result, binary_uint64_at(data));
+}
+
+inline void append_binary_timestamp(string &result, const uint8_t *data, size_t length) {
+	if (length != 8) throw runtime_error("Invalid binary timestamp value");
+	int64_t microseconds = binary_uint64_at(data);
+	if (microseconds == INT64_MIN) {
+		result += "-infinity";
+	} else if (microseconds == INT64_MAX) {
+		result += "infinity";
+	} else {
+		int64_t days = microseconds/MICROSECONDS_PER_DAY, time_of_day = microseconds % MICROSECONDS_PER_DAY;
+		if (time_of_day < 0) {
+			days--;
+			time_of_day += MICROSECONDS_PER_DAY;
+		}
+		bool bc;
+		append_binary_days(result, days, bc);
+		result += ' ';
+		append_binary_time_of_day(result, time_of_day);
+		if (bc) result += " BC";
+	}
+}
+
+#endif
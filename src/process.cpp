@@ -4,6 +4,7 @@
 #include <cerrno>
 #include <cstring>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/wait.h>
 
 #include "unidirectional_pipe.h"
@@ -37,6 +38,13 @@ pid_t Process::fork_and_exec(const string &binary, const char *args[]) {
 	}
 }
 
+// dup2 clears the close-on-exec flag on the new descriptor, but does nothing if the descriptor was already in place
+static void clear_close_on_exec(int fd) {
+	if (fcntl(fd, F_SETFD, 0) < 0) {
+		throw runtime_error("Couldn't clear close-on-exec flag: " + string(strerror(errno)));
+	}
+}
+
 pid_t Process::fork_and_exec(const string &binary, const char *args[], UnidirectionalPipe &stdin_pipe, UnidirectionalPipe &stdout_pipe) {
 	pid_t child = fork();
 
@@ -51,10 +59,12 @@ pid_t Process::fork_and_exec(const string &binary, const char *args[], Unidirect
 
 		// attach our stdin
 		stdin_pipe.dup_read_to(STDIN_FILENO);
+		clear_close_on_exec(STDIN_FILENO);
 		stdin_pipe.close_read();
 
 		// attach our stdout
 		stdout_pipe.dup_write_to(STDOUT_FILENO);
+		clear_close_on_exec(STDOUT_FILENO);
 		stdout_pipe.close_write();
 
 		// run the binary
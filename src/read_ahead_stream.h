@@ -0,0 +1,154 @@
+#ifndef READ_AHEAD_STREAM_H
+#define READ_AHEAD_STREAM_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include "message_pack/unpack.h"
+#include "message_pack/copy_packed.h"
+#include "fdstream.h"
+
+// wraps another stream, decoding complete messagepack values from it on a separate thread and queueing
+// them up so that the thread reading from us (which is applying changes to the database) doesn't have to
+// wait for the network, and the other end doesn't have to wait for that thread before it can send more.
+// the queue is bounded by max_buffered_bytes, so we still provide flow control if the database can't keep
+// up with the network - the decoder thread simply stops reading once the queue is full.
+template <typename Stream>
+struct ReadAheadStream {
+	ReadAheadStream(Stream &stream, size_t max_buffered_bytes): stream(stream), max_buffered_bytes(max_buffered_bytes), buffered_bytes(0), value_pos(0), flush_before_waiting(nullptr), started(false), closed(false), finished(false) {}
+
+	~ReadAheadStream() {
+		close();
+		if (decoder_thread.joinable()) decoder_thread.join();
+	}
+
+	// stops queueing values; the decoder thread will keep reading (and discarding) values until the
+	// underlying stream is closed, so that the other end doesn't block trying to write to us.
+	void close() {
+		std::unique_lock<std::mutex> lock(mutex);
+		closed = true;
+		space_available.notify_one();
+	}
+
+	// makes us force_flush() the given output stream before we wait for the decoder thread, since the other end
+	// may not send us anything more until it has received what we've buffered up.  the output stream must only be
+	// used from the same thread as we are read from.
+	void flush_when_blocking(FDWriteStream &output) {
+		flush_before_waiting = &output;
+	}
+
+	// reads the given number of bytes from the data stream without unpacking or endian conversion
+	inline void read(uint8_t *dest, size_t bytes) {
+		while (bytes > current.size() - value_pos) {
+			size_t avail = current.size() - value_pos;
+			memcpy(dest, current.data() + value_pos, avail);
+			dest  += avail;
+			bytes -= avail;
+			next_value();
+		}
+		memcpy(dest, current.data() + value_pos, bytes);
+		value_pos += bytes;
+	}
+
+	// returns the rest of the current value, which may be consumed using skip(); moves on to the next value first
+	// if we've used it all, so should only be used when about to read.  since the values are whole messages,
+	// this is normally a complete row.
+	inline const uint8_t *peek(size_t &bytes_available) {
+		if (value_pos == current.size()) next_value();
+		bytes_available = current.size() - value_pos;
+		return current.data() + value_pos;
+	}
+
+	inline void skip(size_t bytes) {
+		while (bytes > current.size() - value_pos) {
+			bytes -= current.size() - value_pos;
+			next_value();
+		}
+		value_pos += bytes;
+	}
+
+protected:
+	// moves on to the next value decoded by the decoder thread, waiting for it if necessary.  if the decoder
+	// thread has stopped because of an error (including the stream being closed), rethrows that error.
+	void next_value() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// we don't start reading until asked to, so that if the caller fails before it sends anything to
+		// the other end, we won't be left blocked waiting for the other end to send something to us
+		if (!started) {
+			started = true;
+			decoder_thread = std::thread(&ReadAheadStream<Stream>::decode, this);
+		}
+
+		while (values.empty()) {
+			if (finished) std::rethrow_exception(error);
+
+			if (flush_before_waiting && flush_before_waiting->have_buffered_bytes()) {
+				// don't hold the lock while we write, or the decoder thread couldn't make room for the other
+				// end to send to us if it's blocked trying to do that before it reads what we're writing
+				lock.unlock();
+				flush_before_waiting->force_flush();
+				lock.lock();
+				continue;
+			}
+
+			value_available.wait(lock);
+		}
+
+		bool was_full = (buffered_bytes >= max_buffered_bytes);
+		current = std::move(values.front());
+		values.pop_front();
+		value_pos = 0;
+		buffered_bytes -= current.size();
+		if (was_full) space_available.notify_one();
+	}
+
+	void decode() {
+		Unpacker<Stream> unpacker(stream);
+
+		try {
+			while (true) {
+				PackedValue value;
+				unpacker >> value;
+
+				std::unique_lock<std::mutex> lock(mutex);
+				while (buffered_bytes >= max_buffered_bytes && !closed) {
+					space_available.wait(lock);
+				}
+				if (!closed) {
+					buffered_bytes += value.size();
+					values.push_back(std::move(value));
+					value_available.notify_one();
+				}
+			}
+		} catch (...) {
+			std::unique_lock<std::mutex> lock(mutex);
+			error = std::current_exception();
+			finished = true;
+			value_available.notify_one();
+		}
+	}
+
+	Stream &stream;
+	size_t max_buffered_bytes;
+
+	std::mutex mutex;
+	std::condition_variable value_available;
+	std::condition_variable space_available;
+	std::deque<PackedValue> values;
+	size_t buffered_bytes;
+	std::exception_ptr error;
+
+	PackedValue current;
+	size_t value_pos;
+	FDWriteStream *flush_before_waiting;
+
+	bool started;
+	bool closed;
+	bool finished;
+	std::thread decoder_thread;
+};
+
+#endif
@@ -3,6 +3,10 @@
 
 template <typename DatabaseClient, bool = is_base_of<SequenceColumns, DatabaseClient>::value>
 struct ResetTableSequences {
+	static bool required(const Table &table) {
+		return false;
+	}
+
 	static void execute(DatabaseClient &client, const Table &table) {
 		/* nothing required */
 	}
@@ -10,6 +14,13 @@ struct ResetTableSequences {
 
 template <typename DatabaseClient>
 struct ResetTableSequences <DatabaseClient, true> {
+	static bool required(const Table &table) {
+		for (const Column &column : table.columns) {
+			if (column.default_type == DefaultType::sequence) return true;
+		}
+		return false;
+	}
+
 	static void execute(DatabaseClient &client, const Table &table) {
 		for (const Column &column : table.columns) {
 			if (column.default_type == DefaultType::sequence) {
@@ -1,7 +1,30 @@
 #ifndef ROW_RANGE_APPLIER_H
 #define ROW_RANGE_APPLIER_H
 
+#include <algorithm>
 #include "row_replacer.h"
+#include "arena.h"
+#include "message_pack/flat_row.h"
+#include "rows_decoder.h"
+#include "xxHash/xxhash.h"
+
+const size_t MIN_SOURCE_ROW_INDEX_SIZE = 64; // must be a power of 2
+
+inline size_t hash_primary_key(const FlatRowView &row, const ColumnIndices &primary_key_columns) {
+	unsigned long long hash = 0;
+	for (size_t column_number : primary_key_columns) {
+		PackedValueView value(row[column_number]);
+		hash = XXH64(value.data(), value.size(), hash);
+	}
+	return hash;
+}
+
+inline bool same_primary_key(const FlatRowView &row, const FlatRowView &other, const ColumnIndices &primary_key_columns) {
+	for (size_t column_number : primary_key_columns) {
+		if (row[column_number] != other[column_number]) return false;
+	}
+	return true;
+}
 
 template <typename DatabaseClient>
 struct RowRangeApplier {
@@ -10,11 +33,18 @@ struct RowRangeApplier {
 	static const size_t MAX_SENSIBLE_INSERT_STATEMENT_SIZE = 4*1024*1024;
 	static const size_t MAX_SENSIBLE_DELETE_STATEMENT_SIZE =     16*1024;
 
-	typedef map<PackedRow, PackedRow> RowsByPrimaryKey;
+	// the source rows and their column offsets are copied into the arena, which is reset each time we apply the
+	// buffered rows rather than freeing each row.  the rows arrive in primary key order, so we keep them in that
+	// order, and look them up by key in an open-addressed hash table as we see each row from our database.
+	struct SourceRow {
+		FlatRowView row;
+		bool matched;
+	};
 
-	RowRangeApplier(RowReplacer<DatabaseClient> &replacer, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key):
+	RowRangeApplier(RowReplacer<DatabaseClient> &replacer, Arena &arena, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key):
 		replacer(replacer),
 		client(replacer.client),
+		arena(arena),
 		table(table),
 		prev_key(prev_key),
 		curr_key(prev_key),
@@ -23,13 +53,12 @@ struct RowRangeApplier {
 	}
 
 	template <typename InputStream>
-	void stream_from_input(Unpacker<InputStream> &input) {
+	void stream_from_input(Unpacker<InputStream> &input, RowsDecoder &decoder) {
 		while (true) {
 			// in the KS protocol command responses are a series of arrays, terminated by an empty array.
 			// this avoids having to determine the number of results in advance; an empty array is not a
 			// valid database row, so it's unambiguous.
-			PackedRow row;
-			input >> row;
+			decoder.read_row(input, row);
 			if (row.size() == 0) break;
 			received_source_row(row);
 		}
@@ -37,18 +66,24 @@ struct RowRangeApplier {
 		received_all_source_rows();
 	}
 
-	PackedRow primary_key_of(const PackedRow &row) {
-		PackedRow primary_key;
-		primary_key.reserve(table.primary_key_columns.size());
-		for (size_t column_number : table.primary_key_columns) {
-			primary_key.push_back(row[column_number]);
+	void set_to_primary_key_of(ColumnValues &key, const FlatRowView &row) {
+		key.resize(table.primary_key_columns.size());
+		for (size_t n = 0; n < table.primary_key_columns.size(); n++) {
+			key[n] = row[table.primary_key_columns[n]];
 		}
-		return primary_key;
 	}
 
-	void received_source_row(const PackedRow &row) {
-		curr_key = primary_key_of(row);
-		source_rows[curr_key] = row;
+	void received_source_row(const FlatRow &row) {
+		set_to_primary_key_of(curr_key, row.view());
+
+		SourceRow *source_row = arena.allocate_array<SourceRow>(1);
+		uint32_t *column_offsets = arena.allocate_array<uint32_t>(row.size());
+		memcpy(column_offsets, row.column_offsets.data(), row.size()*sizeof(uint32_t));
+		source_row->row = FlatRowView(arena.copy(row.encoded.data(), row.encoded_size()), row.encoded_size(), column_offsets, row.size());
+		source_row->matched = false;
+		source_rows.push_back(source_row);
+		index_source_row(source_row);
+		approx_buffered_bytes += row.encoded_size();
 
 		// if the other end is sending a large set of data (for example, the entire remainder of the
 		// table), we need to periodically apply the data received so far rather than buffering up
@@ -56,15 +91,38 @@ struct RowRangeApplier {
 		// mostly avoided this particular problem, but we still had trouble in the case where the
 		// source dataset had deleted a large range that was still present on the local end; this
 		// way around requires fewer special cases.
-		for (const PackedValue &value : row) {
-			approx_buffered_bytes += value.size();
-		}
 		if (approx_buffered_bytes > MAX_BYTES_TO_BUFFER) {
 			check_rows_to_curr_key();
 			insert_remaining_rows(false);
 		}
 	}
 
+	void index_source_row(SourceRow *source_row) {
+		if (source_rows.size()*2 > source_row_index.size()) {
+			// keep the table at most half full; grow it and re-add all the rows, including this one
+			source_row_index.assign(max(source_row_index.size()*2, MIN_SOURCE_ROW_INDEX_SIZE), nullptr);
+			for (SourceRow *indexed_row : source_rows) add_to_source_row_index(indexed_row);
+		} else {
+			add_to_source_row_index(source_row);
+		}
+	}
+
+	void add_to_source_row_index(SourceRow *source_row) {
+		size_t mask = source_row_index.size() - 1;
+		size_t slot = hash_primary_key(source_row->row, table.primary_key_columns) & mask;
+		while (source_row_index[slot]) slot = (slot + 1) & mask;
+		source_row_index[slot] = source_row;
+	}
+
+	SourceRow *find_source_row(const FlatRowView &row) {
+		if (source_row_index.empty()) return nullptr;
+		size_t mask = source_row_index.size() - 1;
+		for (size_t slot = hash_primary_key(row, table.primary_key_columns) & mask; source_row_index[slot]; slot = (slot + 1) & mask) {
+			if (same_primary_key(source_row_index[slot]->row, row, table.primary_key_columns)) return source_row_index[slot];
+		}
+		return nullptr;
+	}
+
 	void received_all_source_rows() {
 		// clear any rows after the last entry we should have in the table (within the range we are
 		// processing, which may or may not go to the end of the table); this is an optimisation, as
@@ -78,7 +136,10 @@ struct RowRangeApplier {
 	}
 
 	void delete_range(const ColumnValues &matched_up_to_key, const ColumnValues &last_not_matching_key) {
-		client.execute("DELETE FROM " + table.name + where_sql(client, table, matched_up_to_key, last_not_matching_key));
+		string sql("DELETE FROM ");
+		sql += table.name;
+		append_where_sql(client, table, matched_up_to_key, last_not_matching_key, sql);
+		client.execute(sql);
 	}
 
 	void check_rows_to_curr_key() {
@@ -92,35 +153,38 @@ struct RowRangeApplier {
 	}
 
 	void operator()(const typename DatabaseClient::RowType &database_row) {
-		PackedRow row;
-		database_row.pack_row_into(row);
-		prev_key = primary_key_of(row);
+		row.clear();
+		database_row.pack_row_into(row); // reuses row's buffers
+		set_to_primary_key_of(prev_key, row.view());
 
-		RowsByPrimaryKey::iterator source_row = source_rows.find(prev_key);
+		SourceRow *source_row = find_source_row(row.view());
 
-		if (source_row == source_rows.end()) {
+		if (!source_row) {
 			// we have a row that we shouldn't have, so we need to remove it
 			replacer.remove_row(row);
 
-		} else if (source_row->second != row) {
+		} else if (source_row->row != row.view()) {
 			// we do have the row at both ends, but it's changed, so we need to replace it
-			replacer.replace_row(source_row->second);
+			replacer.replace_row(source_row->row);
 
-			// don't want to delete this row later
-			source_rows.erase(source_row);
+			// don't want to insert this row later
+			source_row->matched = true;
 
 		} else {
-			// the row matches; don't want to delete this row later
-			source_rows.erase(source_row);
+			// the row matches; don't want to insert this row later
+			source_row->matched = true;
 		}
 	}
 
 	void insert_remaining_rows(bool end_of_table) {
-		for (RowsByPrimaryKey::iterator source_row = source_rows.begin(); source_row != source_rows.end(); ++source_row) {
-			end_of_table ? replacer.append_row(source_row->second) : replacer.insert_row(source_row->second);
+		for (const SourceRow *source_row : source_rows) {
+			if (source_row->matched) continue;
+			end_of_table ? replacer.append_row(source_row->row) : replacer.insert_row(source_row->row);
 			apply_if_necessary();
 		}
+		fill(source_row_index.begin(), source_row_index.end(), nullptr);
 		source_rows.clear();
+		arena.reset();
 		approx_buffered_bytes = 0;
 	}
 
@@ -130,7 +194,7 @@ struct RowRangeApplier {
 		// note that this method is only called while retrieve_rows is not running - we can't
 		// execute another statement while one is already running, because we turn off database
 		// client row buffering for efficiency.
-		if (replacer.insert_sql.curr.size() > MAX_SENSIBLE_INSERT_STATEMENT_SIZE ||
+		if (replacer.insert_size() > MAX_SENSIBLE_INSERT_STATEMENT_SIZE ||
 			replacer.primary_key_clearer.delete_sql.curr.size() > MAX_SENSIBLE_DELETE_STATEMENT_SIZE) {
 			replacer.apply();
 		}
@@ -138,11 +202,14 @@ struct RowRangeApplier {
 
 	RowReplacer<DatabaseClient> &replacer;
 	DatabaseClient &client;
+	Arena &arena;
 	const Table &table;
 	ColumnValues prev_key;
 	ColumnValues curr_key;
 	ColumnValues last_key;
-	RowsByPrimaryKey source_rows;
+	vector<SourceRow*> source_rows;
+	vector<SourceRow*> source_row_index;
+	FlatRow row; // the row most recently received or retrieved from our database
 	size_t approx_buffered_bytes;
 };
 
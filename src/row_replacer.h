@@ -1,23 +1,203 @@
 #ifndef SQL_ROW_REPLACER
 #define SQL_ROW_REPLACER
 
+#include <algorithm>
 #include <functional>
 
 #include "database_client_traits.h"
 #include "sql_functions.h"
 #include "unique_key_clearer.h"
 
-template <typename DatabaseClient>
-void append_row_tuple(DatabaseClient &client, const Columns &columns, BaseSQL &sql, const PackedRow &row) {
+// row may be a PackedRow or a FlatRow, here and in the other row methods below
+template <typename DatabaseClient, typename Row>
+void append_row_tuple(DatabaseClient &client, const Columns &columns, const ColumnEncoders<DatabaseClient> &encoders, BaseSQL &sql, const Row &row) {
 	if (sql.have_content()) sql += "),\n(";
 	for (size_t n = 0; n < row.size(); n++) {
 		if (n > 0) {
 			sql += ',';
 		}
-		sql += encode(client, columns[n], row[n]);
+		encoders.append(client, columns, n, row[n], sql.curr);
 	}
 }
 
+// builds up big multi-row INSERT statements
+template <typename DatabaseClient, bool = is_base_of<SupportsCopy, DatabaseClient>::value>
+struct RowInserter {
+	RowInserter(DatabaseClient &client, const Table &table):
+		client(client),
+		columns(table.columns),
+		encoders(table.columns),
+		insert_sql("INSERT INTO " + table.name + " VALUES\n(", ")") {
+	}
+
+	template <typename Row>
+	inline void append_row(const Row &row) {
+		append_row_tuple(client, columns, encoders, insert_sql, row);
+	}
+
+	inline size_t size() const {
+		return insert_sql.curr.size();
+	}
+
+	inline void apply() {
+		insert_sql.apply(client);
+	}
+
+	DatabaseClient &client;
+	const Columns &columns;
+	ColumnEncoders<DatabaseClient> encoders;
+	BaseSQL insert_sql;
+};
+
+// databases that support COPY can load rows from a stream of plain data instead, which saves the server parsing
+// a huge statement.  as with INSERT, the rows being replaced and any rows with conflicting unique key values
+// have been cleared by the time we apply, so we can copy straight into the table.
+template <typename DatabaseClient>
+struct RowInserter<DatabaseClient, true> {
+	RowInserter(DatabaseClient &client, const Table &table):
+		client(client),
+		columns(table.columns) {
+		copy_sql = "COPY " + table.name + " ";
+		append_columns_list(client, table.columns, all_columns_of(table), copy_sql);
+		copy_sql += " FROM STDIN";
+	}
+
+	static ColumnIndices all_columns_of(const Table &table) {
+		ColumnIndices result;
+		for (size_t n = 0; n < table.columns.size(); n++) result.push_back(n);
+		return result;
+	}
+
+	template <typename Row>
+	inline void append_row(const Row &row) {
+		for (size_t n = 0; n < row.size(); n++) {
+			if (n > 0) {
+				copy_data += '\t';
+			}
+			append_copy_encoded(client, columns[n], row[n], copy_data);
+		}
+		copy_data += '\n';
+	}
+
+	inline size_t size() const {
+		return copy_data.size();
+	}
+
+	inline void apply() {
+		if (!copy_data.empty()) {
+			client.copy_rows_in(copy_sql, copy_data);
+			copy_data.clear(); // keeps its buffer
+		}
+	}
+
+	DatabaseClient &client;
+	const Columns &columns;
+	string copy_sql;
+	string copy_data;
+};
+
+// databases that can update rows that conflict with the rows being inserted let us replace rows in one statement,
+// rather than deleting them and inserting them again, which writes every index entry twice; but that depends on
+// the server version, so clients also tell us at runtime with supports_upsert().
+template <typename DatabaseClient, bool = is_base_of<SupportsUpsert, DatabaseClient>::value>
+struct RowUpserter {
+	RowUpserter(DatabaseClient &client, const Table &table) {}
+
+	inline bool enabled() const { return false; }
+	template <typename Row> inline void append_row(const Row &row) {}
+	inline size_t size() const { return 0; }
+	inline void apply() {}
+};
+
+template <typename DatabaseClient>
+struct RowUpserter<DatabaseClient, true> {
+	RowUpserter(DatabaseClient &client, const Table &table):
+		client(client),
+		columns(table.columns),
+		encoders(table.columns),
+		upsert_sql("INSERT INTO " + table.name + " VALUES\n(", upsert_suffix(client, table)),
+		supported(client.supports_upsert()) {
+	}
+
+	static string upsert_suffix(DatabaseClient &client, const Table &table) {
+		string result(")\nON CONFLICT ");
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
+
+		string assignments;
+		for (size_t n = 0; n < table.columns.size(); n++) {
+			if (find(table.primary_key_columns.begin(), table.primary_key_columns.end(), n) != table.primary_key_columns.end()) continue;
+			if (!assignments.empty()) assignments += ", ";
+			assignments += client.quote_identifiers_with();
+			assignments += table.columns[n].name;
+			assignments += client.quote_identifiers_with();
+			assignments += " = EXCLUDED.";
+			assignments += client.quote_identifiers_with();
+			assignments += table.columns[n].name;
+			assignments += client.quote_identifiers_with();
+		}
+
+		// if every column is in the primary key, an existing row must already be identical
+		result += (assignments.empty() ? " DO NOTHING" : " DO UPDATE SET " + assignments);
+		return result;
+	}
+
+	inline bool enabled() const {
+		return supported;
+	}
+
+	template <typename Row>
+	inline void append_row(const Row &row) {
+		append_row_tuple(client, columns, encoders, upsert_sql, row);
+	}
+
+	inline size_t size() const {
+		return upsert_sql.curr.size();
+	}
+
+	inline void apply() {
+		upsert_sql.apply(client);
+	}
+
+	DatabaseClient &client;
+	const Columns &columns;
+	ColumnEncoders<DatabaseClient> encoders;
+	BaseSQL upsert_sql;
+	bool supported;
+};
+
+// databases that support pipelining can be sent a series of statements without waiting for the result of each
+// before sending the next, which saves a round trip per statement when the database server is far away.
+// statements given to client.execute() between construction and sync() are pipelined if the client supports it.
+template <typename DatabaseClient, bool = is_base_of<SupportsPipelining, DatabaseClient>::value>
+struct StatementPipeline {
+	StatementPipeline(DatabaseClient &client) {}
+
+	inline void sync() {}
+};
+
+template <typename DatabaseClient>
+struct StatementPipeline<DatabaseClient, true> {
+	StatementPipeline(DatabaseClient &client): client(client), started(client.enter_pipeline_mode()) {}
+
+	~StatementPipeline() {
+		// if a statement failed to send, we still need to wait for the server to finish with the others before
+		// we can use the connection again; the original exception is the one to report
+		if (started) {
+			try { sync(); } catch (...) {}
+		}
+	}
+
+	inline void sync() {
+		if (started) {
+			started = false;
+			client.sync_pipeline(); // throws if any of the statements failed
+		}
+	}
+
+	DatabaseClient &client;
+	bool started;
+};
+
 typedef std::function<void ()> ProgressCallback;
 
 // databases that don't support the REPLACE statement must explicitly clear conflicting rows
@@ -25,8 +205,8 @@ template <typename DatabaseClient, bool = is_base_of<SupportsReplace, DatabaseCl
 struct RowReplacer {
 	RowReplacer(DatabaseClient &client, const Table &table, bool commit_often, ProgressCallback progress_callback):
 		client(client),
-		columns(table.columns),
-		insert_sql("INSERT INTO " + table.name + " VALUES\n(", ")"),
+		inserter(client, table),
+		upserter(client, table),
 		primary_key_clearer(client, table, table.primary_key_columns),
 		commit_often(commit_often),
 		progress_callback(progress_callback),
@@ -39,15 +219,17 @@ struct RowReplacer {
 		}
 	}
 
-	inline void append_row(const PackedRow &row) {
+	template <typename Row>
+	inline void append_row(const Row &row) {
 		// if we're inserting rows at the end of the table, by definition there are no later rows,
 		// so unlike insert_row we don't need to clear later conflicting unique key values.
-		append_row_tuple(client, columns, insert_sql, row);
+		inserter.append_row(row);
 
 		rows_changed++;
 	}
 
-	void insert_row(const PackedRow &row) {
+	template <typename Row>
+	void insert_row(const Row &row) {
 		// before we can insert our rows we will also have to first clear any later rows with the
 		// same unique key values.
 		for (UniqueKeyClearer<DatabaseClient> &unique_key_clearer : unique_keys_clearers) {
@@ -58,27 +240,49 @@ struct RowReplacer {
 		append_row(row);
 	}
 
-	inline void replace_row(const PackedRow &row) {
+	template <typename Row>
+	inline void replace_row(const Row &row) {
+		if (upserter.enabled()) {
+			// the upsert takes care of the existing row with the same primary key, but we still need to clear any
+			// later rows with the same unique key values, as for insert_row
+			for (UniqueKeyClearer<DatabaseClient> &unique_key_clearer : unique_keys_clearers) {
+				unique_key_clearer.row(row);
+			}
+			upserter.append_row(row);
+			rows_changed++;
+			return;
+		}
+
 		// when we apply(), first we will delete existing rows - we do that rather than use UPDATE
 		// statements because you can't really batch UPDATE, whereas you can batch DELETE & INSERT.
 		primary_key_clearer.row(row);
 		insert_row(row);
 	}
 
-	inline void remove_row(const PackedRow &row) {
+	template <typename Row>
+	inline void remove_row(const Row &row) {
 		primary_key_clearer.row(row);
 
 		rows_changed++;
 	}
 
 	inline void apply() {
+		// none of the statements below depend on the results of the others, so we don't need to wait for each
+		// to complete before sending the next; but COPY can't be pipelined, so that has to come after the sync
+		StatementPipeline<DatabaseClient> pipeline(client);
+
 		primary_key_clearer.apply();
 
 		for (UniqueKeyClearer<DatabaseClient> &unique_key_clearer : unique_keys_clearers) {
 			unique_key_clearer.apply();
 		}
 
-		insert_sql.apply(client);
+		// the upserts must come before the inserts, since a row appended at the end of the table may take a unique
+		// value that one of the replaced rows is giving up
+		upserter.apply();
+		pipeline.sync();
+
+		inserter.apply();
 
 		if (commit_often) {
 			client.commit_transaction();
@@ -90,9 +294,13 @@ struct RowReplacer {
 		}
 	}
 
+	inline size_t insert_size() const {
+		return inserter.size() + upserter.size();
+	}
+
 	DatabaseClient &client;
-	const Columns &columns;
-	BaseSQL insert_sql;
+	RowInserter<DatabaseClient> inserter;
+	RowUpserter<DatabaseClient> upserter;
 	UniqueKeyClearer<DatabaseClient> primary_key_clearer;
 	vector< UniqueKeyClearer<DatabaseClient> > unique_keys_clearers;
 	bool commit_often;
@@ -106,27 +314,32 @@ struct RowReplacer<DatabaseClient, true> {
 	RowReplacer(DatabaseClient &client, const Table &table, bool commit_often, ProgressCallback progress_callback):
 		client(client),
 		columns(table.columns),
+		encoders(table.columns),
 		insert_sql("REPLACE INTO " + table.name + " VALUES\n(", ")"),
 		primary_key_clearer(client, table, table.primary_key_columns),
 		commit_often(commit_often),
 		rows_changed(0) {
 	}
 
-	inline void append_row(const PackedRow &row) {
+	template <typename Row>
+	inline void append_row(const Row &row) {
 		replace_row(row);
 	}
 
-	inline void insert_row(const PackedRow &row) {
+	template <typename Row>
+	inline void insert_row(const Row &row) {
 		replace_row(row);
 	}
 
-	inline void replace_row(const PackedRow &row) {
-		append_row_tuple(client, columns, insert_sql, row);
+	template <typename Row>
+	inline void replace_row(const Row &row) {
+		append_row_tuple(client, columns, encoders, insert_sql, row);
 
 		rows_changed++;
 	}
 
-	inline void remove_row(const PackedRow &row) {
+	template <typename Row>
+	inline void remove_row(const Row &row) {
 		primary_key_clearer.row(row);
 
 		rows_changed++;
@@ -147,8 +360,13 @@ struct RowReplacer<DatabaseClient, true> {
 		}
 	}
 
+	inline size_t insert_size() const {
+		return insert_sql.curr.size();
+	}
+
 	DatabaseClient &client;
 	const Columns &columns;
+	ColumnEncoders<DatabaseClient> encoders;
 	BaseSQL insert_sql;
 	UniqueKeyClearer<DatabaseClient> primary_key_clearer;
 	bool commit_often;
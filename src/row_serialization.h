@@ -24,9 +24,10 @@ struct RowCounter {
 	size_t row_count;
 };
 
-template <typename OutputStream>
+// RowsPacker is normally a Packer, but may be another type that rows can be packed into, such as a DictionaryEncodingPacker
+template <typename RowsPacker>
 struct RowPacker: RowCounter {
-	RowPacker(Packer<OutputStream> &packer): packer(packer) {}
+	RowPacker(RowsPacker &packer): packer(packer) {}
 
 	template <typename DatabaseRow>
 	void operator()(const DatabaseRow &row) {
@@ -38,7 +39,7 @@ struct RowPacker: RowCounter {
 		row_count = 0;
 	}
 
-	Packer<OutputStream> &packer;
+	RowsPacker &packer;
 };
 
 #define MAX_DIGEST_LENGTH MD5_DIGEST_LENGTH
@@ -158,14 +159,14 @@ struct RowHasherAndLastKey: RowHasher, RowLastKey {
 	}
 };
 
-template <typename OutputStream>
-struct RowPackerAndLastKey: RowPacker<OutputStream>, RowLastKey {
-	RowPackerAndLastKey(Packer<OutputStream> &packer, const vector<size_t> &primary_key_columns): RowPacker<OutputStream>(packer), RowLastKey(primary_key_columns) {
+template <typename RowsPacker>
+struct RowPackerAndLastKey: RowPacker<RowsPacker>, RowLastKey {
+	RowPackerAndLastKey(RowsPacker &packer, const vector<size_t> &primary_key_columns): RowPacker<RowsPacker>(packer), RowLastKey(primary_key_columns) {
 	}
 
 	template <typename DatabaseRow>
 	inline void operator()(const DatabaseRow &row) {
-		RowPacker<OutputStream>::operator()(row);
+		RowPacker<RowsPacker>::operator()(row);
 		RowLastKey::operator()(row);
 	}
 };
@@ -0,0 +1,41 @@
+#ifndef ROWS_DECODER_H
+#define ROWS_DECODER_H
+
+#include "rows_encoding.h"
+#include "rows_dictionary.h"
+#include "columnar_batch.h"
+
+// reads the rows in the response to a rows command in whichever encoding was negotiated
+struct RowsDecoder {
+	RowsDecoder(): encoding(RowsEncoding::plain) {}
+
+	// called at the start of each response
+	void start(RowsEncoding rows_encoding) {
+		encoding = rows_encoding;
+		dictionary.clear();
+		columnar.clear();
+	}
+
+	template <typename InputStream>
+	inline void read_row(Unpacker<InputStream> &unpacker, FlatRow &row) {
+		switch (encoding) {
+			case RowsEncoding::plain:
+				unpacker >> row;
+				break;
+
+			case RowsEncoding::dictionary:
+				dictionary.read_row(unpacker, row);
+				break;
+
+			case RowsEncoding::columnar:
+				columnar.read_row(unpacker, row);
+				break;
+		}
+	}
+
+	RowsEncoding encoding;
+	RowsDictionaryDecoder dictionary;
+	ColumnarBatchDecoder columnar;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef ROWS_DICTIONARY_H
+#define ROWS_DICTIONARY_H
+
+#include <vector>
+#include "command.h"
+#include "message_pack/flat_row.h"
+#include "xxHash/xxhash.h"
+
+// strings shorter than this aren't worth replacing with a reference, and we don't keep ones longer than the max
+const size_t MIN_DICTIONARY_STRING_LENGTH = 4;
+const size_t MAX_DICTIONARY_STRING_LENGTH = 255;
+const size_t MAX_DICTIONARY_ENTRIES = 65536;
+const size_t MIN_DICTIONARY_INDEX_SIZE = 1024; // must be a power of 2
+
+// columns such as statuses, country codes and string foreign keys have the same few values over and over, so when
+// the rows encoding is set to dictionary, both ends remember each string sent in full in the response to a rows
+// command, and a string that's already been sent in the same response is sent as a one-element array holding its
+// position in the dictionary.  database values are never arrays, so this is unambiguous.  as with the key cache,
+// this works because both ends apply the same rules to the same values in the same order: every string of an
+// eligible length that isn't sent as a reference gets the next position, until the dictionary is full.
+inline bool dictionary_eligible(size_t length) {
+	return (length >= MIN_DICTIONARY_STRING_LENGTH && length <= MAX_DICTIONARY_STRING_LENGTH);
+}
+
+struct RowsDictionaryEncoder {
+	// called at the start of each response
+	void clear() {
+		strings.clear();
+		offsets.clear();
+		fill(index.begin(), index.end(), 0);
+	}
+
+	// returns true and sets entry if the string has been sent before; otherwise remembers it if there's room
+	bool find_or_add(const uint8_t *data, size_t length, uint32_t &entry) {
+		if (offsets.size()*2 >= index.size() && offsets.size() < MAX_DICTIONARY_ENTRIES) grow_index();
+
+		size_t mask = index.size() - 1;
+		size_t slot = XXH64(data, length, 0) & mask;
+		for (; index[slot]; slot = (slot + 1) & mask) {
+			entry = index[slot] - 1;
+			if (entry_length(entry) == length && memcmp(strings.data() + offsets[entry], data, length) == 0) return true;
+		}
+
+		if (offsets.size() < MAX_DICTIONARY_ENTRIES) {
+			offsets.push_back(strings.size());
+			strings.append((const char *)data, length);
+			index[slot] = offsets.size(); // stored plus one so that 0 means an empty slot
+		}
+		return false;
+	}
+
+	inline size_t entry_length(size_t entry) const {
+		return (entry + 1 < offsets.size() ? offsets[entry + 1] : strings.size()) - offsets[entry];
+	}
+
+	void grow_index() {
+		index.assign(max(index.size()*2, MIN_DICTIONARY_INDEX_SIZE), 0);
+		size_t mask = index.size() - 1;
+		for (size_t entry = 0; entry < offsets.size(); entry++) {
+			size_t slot = XXH64(strings.data() + offsets[entry], entry_length(entry), 0) & mask;
+			while (index[slot]) slot = (slot + 1) & mask;
+			index[slot] = entry + 1;
+		}
+	}
+
+	string strings;
+	vector<uint32_t> offsets;
+	vector<uint32_t> index;
+};
+
+// wraps the packer given to pack_row_into so that the rows' strings go through the dictionary
+template <typename OutputStream>
+struct DictionaryEncodingPacker {
+	DictionaryEncodingPacker(Packer<OutputStream> &packer, RowsDictionaryEncoder &dictionary): packer(packer), dictionary(dictionary) {}
+
+	inline void pack_string(const uint8_t *data, size_t length) {
+		uint32_t entry;
+		if (dictionary_eligible(length) && dictionary.find_or_add(data, length, entry)) {
+			pack_array_length(packer, 1);
+			packer << entry;
+		} else {
+			pack_raw(packer, data, length);
+		}
+	}
+
+	Packer<OutputStream> &packer;
+	RowsDictionaryEncoder &dictionary;
+};
+
+template <typename OutputStream, typename T>
+inline DictionaryEncodingPacker<OutputStream> &operator <<(DictionaryEncodingPacker<OutputStream> &packer, const T &obj) {
+	packer.packer << obj;
+	return packer;
+}
+
+template <typename OutputStream>
+inline DictionaryEncodingPacker<OutputStream> &operator <<(DictionaryEncodingPacker<OutputStream> &packer, const std::string &obj) {
+	packer.pack_string((const uint8_t *)obj.data(), obj.size());
+	return packer;
+}
+
+template <typename OutputStream>
+inline DictionaryEncodingPacker<OutputStream> &operator <<(DictionaryEncodingPacker<OutputStream> &packer, const memory &obj) {
+	packer.pack_string((const uint8_t *)obj.buf, obj.size);
+	return packer;
+}
+
+template <typename OutputStream>
+inline void pack_array_length(DictionaryEncodingPacker<OutputStream> &packer, size_t size) {
+	pack_array_length(packer.packer, size);
+}
+
+// the receiving end keeps the strings in their packed form, so it can copy them straight into the rows
+struct RowsDictionaryDecoder {
+	// called at the start of each response
+	void clear() {
+		values.clear();
+		offsets.clear();
+	}
+
+	template <typename InputStream>
+	void read_row(Unpacker<InputStream> &unpacker, FlatRow &row) {
+		size_t columns = unpacker.next_array_length();
+		row.clear();
+		row.reserve(columns);
+		while (columns--) {
+			row.start_column();
+			size_t start = row.encoded.size();
+			copy_object(unpacker, row.encoded);
+			PackedValueView value(row.encoded.data() + start, row.encoded.size() - start);
+			const uint8_t *string_data;
+			size_t string_length;
+
+			if (value.leader() == MSGPACK_FIXARRAY_MIN + 1) {
+				VectorReadStream stream(value);
+				Unpacker<VectorReadStream> value_unpacker(stream);
+				value_unpacker.next_array_length();
+				size_t entry = value_unpacker.template next<size_t>();
+				if (entry >= offsets.size()) throw command_error("Invalid dictionary reference " + to_string(entry));
+				row.encoded.truncate(start);
+				size_t end = (entry + 1 < offsets.size() ? offsets[entry + 1] : values.size());
+				row.encoded.write(values.data() + offsets[entry], end - offsets[entry]);
+
+			} else if (value.raw_bytes(string_data, string_length)) {
+				if (dictionary_eligible(string_length) && offsets.size() < MAX_DICTIONARY_ENTRIES) {
+					offsets.push_back(values.size());
+					values.write(value.data(), value.size());
+				}
+			}
+		}
+	}
+
+	PackedValue values;
+	vector<size_t> offsets;
+};
+
+#endif
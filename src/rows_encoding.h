@@ -0,0 +1,10 @@
+#ifndef ROWS_ENCODING_H
+#define ROWS_ENCODING_H
+
+enum RowsEncoding {
+	plain = 0,
+	dictionary = 1,
+	columnar = 2,
+};
+
+#endif
@@ -8,3 +8,11 @@ size_t Table::index_of_column(const string &name) const {
 	}
 	throw out_of_range("Unknown column " + name);
 }
+
+Table Table::partition_table(const Partition &partition) const {
+	// the queries we run for a table just need its name replaced to apply to only the partition instead
+	Table result(*this);
+	result.name = partition.name;
+	result.partitions.clear();
+	return result;
+}
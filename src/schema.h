@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include "message_pack/packed_value.h"
 
 using namespace std;
@@ -71,12 +72,29 @@ struct Key {
 
 typedef vector<Key> Keys;
 
+struct Partition {
+	string name; // what we query the partition's rows by in place of the table name, which depends on the database server
+	string definition; // the partitioning method and the partition's bounds, so we can tell if the rows belong in the same partition at both ends
+
+	inline Partition(const string &name, const string &definition): name(name), definition(definition) {}
+	inline Partition() {}
+
+	inline bool operator ==(const Partition &other) const { return (name == other.name && definition == other.definition); }
+	inline bool operator !=(const Partition &other) const { return (!(*this == other)); }
+};
+
+typedef vector<Partition> Partitions;
+
 struct Table {
 	string name;
 	Columns columns;
 	ColumnIndices primary_key_columns;
 	Keys keys;
 
+	// partitions don't affect whether the schemas match, but if they are the same at both ends each partition can be
+	// synced separately, concurrently with the others
+	Partitions partitions;
+
 	// the following member isn't serialized currently (could be, but not required):
 	string where_conditions;
 
@@ -87,6 +105,7 @@ struct Table {
 	inline bool operator ==(const Table &other) const { return (name == other.name && columns == other.columns && primary_key_columns == other.primary_key_columns && keys == other.keys); }
 	inline bool operator !=(const Table &other) const { return (!(*this == other)); }
 	size_t index_of_column(const string &name) const;
+	Table partition_table(const Partition &partition) const;
 };
 
 typedef vector<Table> Tables;
@@ -95,4 +114,25 @@ struct Database {
 	Tables tables;
 };
 
+// looks up tables by name, for the schema listers, which receive the columns and keys of all the tables at once
+// rather than querying each table in turn.  the rows for each table are adjacent, so we remember the last table
+// found.  tables must not be added to or removed from the list while this is in use.
+struct TableFinder {
+	inline TableFinder(Tables &tables): last_found(nullptr) {
+		tables_by_name.reserve(tables.size());
+		for (Table &table : tables) tables_by_name[table.name] = &table;
+	}
+
+	inline Table *find(const string &name) {
+		if (!last_found || last_found->name != name) {
+			unordered_map<string, Table*>::const_iterator it = tables_by_name.find(name);
+			last_found = (it == tables_by_name.end() ? nullptr : it->second);
+		}
+		return last_found;
+	}
+
+	unordered_map<string, Table*> tables_by_name;
+	Table *last_found;
+};
+
 #endif
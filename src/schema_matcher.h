@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <list>
+#include <unordered_map>
 
 #include "database_client_traits.h"
 #include "schema.h"
@@ -44,7 +45,7 @@ struct CreateKeyStatements {
 		result += " ON ";
 		result += table.name;
 		result += ' ';
-		result += columns_list(client, table.columns, key.columns);
+		append_columns_list(client, table.columns, key.columns, result);
 		statements.push_back(result);
 	}
 };
@@ -129,7 +130,7 @@ struct CreateTableStatements {
 			result += client.column_definition(table, *column);
 		}
 		result += ",\n  PRIMARY KEY";
-		result += columns_list(client, table.columns, table.primary_key_columns);
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
 		result += ")";
 		statements.push_back(result);
 
@@ -357,38 +358,53 @@ struct SchemaMatcher {
 		match_tables(from_database.tables, to_database.tables);
 	}
 
-	void match_tables(Tables from_tables, Tables &to_tables) { // copies from_tables so we can sort it, mutates to_tables
-		// sort the table lists so they have the same order - they typically are already,
-		// but in the database server it depends on locale, so we enforce consistency here
-		sort(from_tables.begin(), from_tables.end());
-		sort(  to_tables.begin(),   to_tables.end());
-
-		Tables::iterator from_table = from_tables.begin();
-		Tables::iterator   to_table =   to_tables.begin();
-		while (to_table != to_tables.end()) {
-			if (from_table == from_tables.end() ||
-				from_table->name > to_table->name) {
-				// our end has an extra table, drop it
-				DropTableStatements<DatabaseClient>::add_to(statements, client, *to_table);
-				to_table = to_tables.erase(to_table);
-				// keep the current from_table and re-evaluate on the next iteration
-
-			} else if (to_table->name > from_table->name) {
-				CreateTableStatements<DatabaseClient>::add_to(statements, client, *from_table);
-				to_table = ++to_tables.insert(to_table, *from_table);
-				++from_table;
+	void match_tables(const Tables &from_tables, Tables &to_tables) { // mutates to_tables
+		// look up the tables by name rather than walking through sorted copies of the two lists, so that this
+		// stays fast for schemas with many thousands of tables.  we still process the tables in name order, since
+		// their order in the database server depends on locale and we want the statements to be consistent.
+		vector<const Table*> sorted_from_tables;
+		sorted_from_tables.reserve(from_tables.size());
+		unordered_map<string, const Table*> from_tables_by_name;
+		for (const Table &table : from_tables) {
+			sorted_from_tables.push_back(&table);
+			from_tables_by_name[table.name] = &table;
+		}
+		sort(sorted_from_tables.begin(), sorted_from_tables.end(), [](const Table *a, const Table *b) { return (*a < *b); });
 
-			} else {
-				match_table(*from_table, *to_table);
-				++to_table;
-				++from_table;
+		// our end may have extra tables, drop them
+		vector<Table*> sorted_to_tables;
+		for (Table &table : to_tables) {
+			if (!from_tables_by_name.count(table.name)) {
+				sorted_to_tables.push_back(&table);
 			}
 		}
-		while (from_table != from_tables.end()) {
-			CreateTableStatements<DatabaseClient>::add_to(statements, client, *from_table);
-			to_tables.push_back(*from_table);
-			++from_table;
+		sort(sorted_to_tables.begin(), sorted_to_tables.end(), [](const Table *a, const Table *b) { return (*a < *b); });
+		for (const Table *to_table : sorted_to_tables) {
+			DropTableStatements<DatabaseClient>::add_to(statements, client, *to_table);
+		}
+
+		unordered_map<string, Table*> to_tables_by_name;
+		for (Table &table : to_tables) {
+			if (from_tables_by_name.count(table.name)) {
+				to_tables_by_name[table.name] = &table;
+			}
+		}
+
+		Tables matched_tables;
+		matched_tables.reserve(from_tables.size());
+		for (const Table *from_table : sorted_from_tables) {
+			unordered_map<string, Table*>::iterator to_table = to_tables_by_name.find(from_table->name);
+			if (to_table == to_tables_by_name.end()) {
+				// their end has an extra table, create it
+				CreateTableStatements<DatabaseClient>::add_to(statements, client, *from_table);
+				matched_tables.push_back(*from_table);
+			} else {
+				Table from_table_copy(*from_table); // so we can sort its keys
+				match_table(from_table_copy, *to_table->second);
+				matched_tables.push_back(move(*to_table->second));
+			}
 		}
+		to_tables.swap(matched_tables);
 	}
 
 	void match_table(Table &from_table, Table &to_table) {
@@ -60,9 +60,18 @@ void operator << (Packer<OutputStream> &packer, const Key &key) {
 	packer << key.columns;
 }
 
+template <typename OutputStream>
+void operator << (Packer<OutputStream> &packer, const Partition &partition) {
+	pack_map_length(packer, 2);
+	packer << string("name");
+	packer << partition.name;
+	packer << string("definition");
+	packer << partition.definition;
+}
+
 template <typename OutputStream>
 void operator << (Packer<OutputStream> &packer, const Table &table) {
-	pack_map_length(packer, 4);
+	pack_map_length(packer, table.partitions.empty() ? 4 : 5);
 	packer << string("name");
 	packer << table.name;
 	packer << string("columns");
@@ -71,6 +80,10 @@ void operator << (Packer<OutputStream> &packer, const Table &table) {
 	packer << table.primary_key_columns;
 	packer << string("keys");
 	packer << table.keys;
+	if (!table.partitions.empty()) {
+		packer << string("partitions");
+		packer << table.partitions;
+	}
 }
 
 template <typename OutputStream>
@@ -133,6 +146,24 @@ void operator >> (Unpacker<InputStream> &unpacker, Key &key) {
 	}
 }
 
+template <typename InputStream>
+void operator >> (Unpacker<InputStream> &unpacker, Partition &partition) {
+	size_t map_length = unpacker.next_map_length(); // checks type
+
+	while (map_length--) {
+		string attr_key = unpacker.template next<string>();
+
+		if (attr_key == "name") {
+			unpacker >> partition.name;
+		} else if (attr_key == "definition") {
+			unpacker >> partition.definition;
+		} else {
+			// ignore anything else, for forward compatibility
+			unpacker.skip();
+		}
+	}
+}
+
 template <typename InputStream>
 void operator >> (Unpacker<InputStream> &unpacker, Table &table) {
 	size_t map_length = unpacker.next_map_length(); // checks type
@@ -148,6 +179,8 @@ void operator >> (Unpacker<InputStream> &unpacker, Table &table) {
 			unpacker >> table.primary_key_columns;
 		} else if (attr_key == "keys") {
 			unpacker >> table.keys;
+		} else if (attr_key == "partitions") {
+			unpacker >> table.partitions;
 		} else {
 			// ignore anything else, for forward compatibility
 			unpacker.skip();
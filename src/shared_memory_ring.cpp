@@ -0,0 +1,314 @@
+#include "shared_memory_ring.h"
+
+#include <stdexcept>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+using namespace std;
+
+#if defined(__linux__) && defined(MFD_ALLOW_SEALING) && defined(F_SEAL_GROW)
+#define HAVE_SHARED_MEMORY_RINGS
+
+const unsigned int RING_SEALS = F_SEAL_SHRINK | F_SEAL_GROW;
+const size_t RING_HEADER_SIZE = 4096;
+const uint32_t RING_MAGIC = 0x4b53524e; // "KSRN"
+const uint32_t RING_VERSION = 1;
+const long LIVENESS_CHECK_INTERVAL_NANOSECONDS = 100*1000*1000;
+
+// lives in the first page of the memfd.  the magic value and version identify the memfd as one of our rings, since
+// we may inherit other sealed memfds.  the positions only ever increase; the futex words are bumped after every
+// change that the other end might be waiting for, and the waiting flags tell the other end that it needs to make
+// the wake system call.  each end's fields are on separate cache lines so that they don't bounce between cores.
+struct SharedMemoryRingHeader {
+	uint32_t magic;
+	uint32_t version;
+
+	alignas(64) atomic<uint64_t> write_position;
+	atomic<uint32_t> data_written;
+	atomic<uint32_t> writer_waiting;
+	atomic<uint32_t> writer_closed;
+	atomic<int32_t> writer_pid;
+
+	alignas(64) atomic<uint64_t> read_position;
+	atomic<uint32_t> data_read;
+	atomic<uint32_t> reader_waiting;
+	atomic<uint32_t> reader_closed;
+	atomic<int32_t> reader_pid;
+
+	alignas(64) uint64_t capacity;
+
+	SharedMemoryRingHeader(size_t capacity): magic(RING_MAGIC), version(RING_VERSION), write_position(0), data_written(0), writer_waiting(0), writer_closed(0), writer_pid(0),
+		read_position(0), data_read(0), reader_waiting(0), reader_closed(0), reader_pid(0), capacity(capacity) {}
+};
+
+// returns false if we timed out, true if we were woken or the value had already changed
+static bool futex_wait(atomic<uint32_t> &word, uint32_t expected) {
+	struct timespec timeout;
+	timeout.tv_sec = 0;
+	timeout.tv_nsec = LIVENESS_CHECK_INTERVAL_NANOSECONDS;
+	if (syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0) < 0) {
+		if (errno == ETIMEDOUT) return false;
+		if (errno != EAGAIN && errno != EINTR) throw runtime_error("Couldn't wait on the shared memory ring: " + string(strerror(errno)));
+	}
+	return true;
+}
+
+static void futex_wake(atomic<uint32_t> &word) {
+	syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+// we can't use kill(pid, 0) because that succeeds for a process that has exited but not yet been reaped, and ks
+// doesn't necessarily reap its children in the order they exit
+static bool process_exited(pid_t pid) {
+	if (!pid) return false; // not started yet
+	string path("/proc/" + to_string(pid) + "/stat");
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return (errno == ENOENT);
+	char buf[512];
+	ssize_t bytes_read = ::read(fd, buf, sizeof(buf) - 1);
+	::close(fd);
+	if (bytes_read <= 0) return false;
+	buf[bytes_read] = 0;
+
+	// the command name is in parentheses and may itself contain parentheses, so look for the last one
+	const char *state = strrchr(buf, ')');
+	if (!state || !state[1] || !state[2]) return false;
+	return (state[2] == 'Z' || state[2] == 'X');
+}
+
+bool SharedMemoryRing::supported() {
+	int fd = memfd_create("kitchen_sync", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) return false;
+	::close(fd);
+	return true;
+}
+
+int SharedMemoryRing::create(size_t capacity) {
+	// like all our other descriptors, this isn't inherited by the programs we run unless it's moved to one of the
+	// descriptors they use, which clears the close-on-exec flag (see Process::fork_and_exec)
+	int fd = memfd_create("kitchen_sync", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0) throw runtime_error("Couldn't create a shared memory ring: " + string(strerror(errno)));
+
+	if (ftruncate(fd, RING_HEADER_SIZE + capacity) < 0) {
+		::close(fd);
+		throw runtime_error("Couldn't size the shared memory ring: " + string(strerror(errno)));
+	}
+
+	void *mapped = mmap(nullptr, RING_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		::close(fd);
+		throw runtime_error("Couldn't map the shared memory ring: " + string(strerror(errno)));
+	}
+	new (mapped) SharedMemoryRingHeader(capacity);
+	munmap(mapped, RING_HEADER_SIZE);
+
+	// the seals both stop the size changing under anyone who has it mapped and mark the descriptor as being a ring
+	if (fcntl(fd, F_ADD_SEALS, RING_SEALS) < 0) {
+		::close(fd);
+		throw runtime_error("Couldn't seal the shared memory ring: " + string(strerror(errno)));
+	}
+
+	return fd;
+}
+
+static bool valid_header(const SharedMemoryRingHeader *header) {
+	return (header->magic == RING_MAGIC && header->version == RING_VERSION);
+}
+
+bool SharedMemoryRing::is_ring(int fd) {
+	int seals = fcntl(fd, F_GET_SEALS);
+	if (seals < 0 || (seals & RING_SEALS) != RING_SEALS) return false;
+
+	// the seals only tell us that it's a sealed memfd; check that it's one of ours before anyone maps all of it
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size <= RING_HEADER_SIZE) return false;
+	void *mapped = mmap(nullptr, RING_HEADER_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) return false;
+	bool result = valid_header(static_cast<SharedMemoryRingHeader*>(mapped));
+	munmap(mapped, RING_HEADER_SIZE);
+	return result;
+}
+
+SharedMemoryRing::SharedMemoryRing(int fd) {
+	struct stat st;
+	if (fstat(fd, &st) < 0) throw runtime_error("Couldn't stat the shared memory ring: " + string(strerror(errno)));
+	mapped_size = st.st_size;
+	if (mapped_size <= RING_HEADER_SIZE) throw runtime_error("Shared memory ring is too small");
+
+	void *mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) throw runtime_error("Couldn't map the shared memory ring: " + string(strerror(errno)));
+
+	header = static_cast<SharedMemoryRingHeader*>(mapped);
+	data = static_cast<uint8_t*>(mapped) + RING_HEADER_SIZE;
+	capacity = header->capacity;
+	if (!valid_header(header) || capacity != mapped_size - RING_HEADER_SIZE) {
+		munmap(mapped, mapped_size);
+		throw runtime_error("Shared memory ring has an invalid header");
+	}
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+	munmap(header, mapped_size);
+}
+
+size_t SharedMemoryRing::read(uint8_t *dest, size_t max_bytes) {
+	uint64_t read_position = header->read_position.load(memory_order_relaxed); // only we change it
+
+	while (true) {
+		uint64_t available = header->write_position.load() - read_position;
+
+		if (available) {
+			size_t bytes = min<uint64_t>(available, max_bytes);
+			size_t offset = read_position % capacity;
+			size_t before_wrap = min(bytes, capacity - offset);
+			memcpy(dest, data + offset, before_wrap);
+			memcpy(dest + before_wrap, data, bytes - before_wrap);
+
+			header->read_position.store(read_position + bytes);
+			header->data_read.fetch_add(1);
+			if (header->writer_waiting.load()) futex_wake(header->data_read);
+			return bytes;
+		}
+
+		if (header->writer_closed.load()) {
+			// the writer may have written more before it closed
+			if (header->write_position.load() != read_position) continue;
+			return 0;
+		}
+
+		// say that we're waiting before checking again, so that either we'll see the writer's change or it'll see
+		// our flag and wake us; and take the futex value before that, so that if it wakes us before we start
+		// waiting, the futex value will have changed and our wait will return immediately.
+		uint32_t data_written = header->data_written.load();
+		header->reader_waiting.store(1);
+		if (header->write_position.load() == read_position && !header->writer_closed.load()) {
+			if (!futex_wait(header->data_written, data_written) && process_exited(header->writer_pid.load())) {
+				header->writer_closed.store(1);
+			}
+		}
+		header->reader_waiting.store(0);
+	}
+}
+
+bool SharedMemoryRing::write(const uint8_t *src, size_t bytes) {
+	uint64_t write_position = header->write_position.load(memory_order_relaxed); // only we change it
+
+	while (bytes) {
+		if (header->reader_closed.load()) return false;
+
+		uint64_t space = capacity - (write_position - header->read_position.load());
+
+		if (space) {
+			size_t chunk = min<uint64_t>(space, bytes);
+			size_t offset = write_position % capacity;
+			size_t before_wrap = min(chunk, capacity - offset);
+			memcpy(data + offset, src, before_wrap);
+			memcpy(data, src + before_wrap, chunk - before_wrap);
+
+			write_position += chunk;
+			src += chunk;
+			bytes -= chunk;
+			header->write_position.store(write_position);
+			header->data_written.fetch_add(1);
+			if (header->reader_waiting.load()) futex_wake(header->data_written);
+			continue;
+		}
+
+		// as for read() above
+		uint32_t data_read = header->data_read.load();
+		header->writer_waiting.store(1);
+		if (write_position - header->read_position.load() == capacity && !header->reader_closed.load()) {
+			if (!futex_wait(header->data_read, data_read) && process_exited(header->reader_pid.load())) {
+				header->reader_closed.store(1);
+			}
+		}
+		header->writer_waiting.store(0);
+	}
+
+	return true;
+}
+
+void SharedMemoryRing::close_read() {
+	header->reader_closed.store(1);
+	header->data_read.fetch_add(1);
+	futex_wake(header->data_read);
+}
+
+void SharedMemoryRing::close_write() {
+	header->writer_closed.store(1);
+	header->data_written.fetch_add(1);
+	futex_wake(header->data_written);
+}
+
+void SharedMemoryRing::set_reader_pid(pid_t pid) {
+	header->reader_pid.store(pid);
+}
+
+void SharedMemoryRing::set_writer_pid(pid_t pid) {
+	header->writer_pid.store(pid);
+}
+
+#else
+
+bool SharedMemoryRing::supported() {
+	return false;
+}
+
+int SharedMemoryRing::create(size_t capacity) {
+	throw runtime_error("Shared memory rings aren't supported on this platform");
+}
+
+bool SharedMemoryRing::is_ring(int fd) {
+	return false;
+}
+
+SharedMemoryRing::SharedMemoryRing(int fd) {
+	throw runtime_error("Shared memory rings aren't supported on this platform");
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+}
+
+size_t SharedMemoryRing::read(uint8_t *dest, size_t max_bytes) {
+	throw logic_error("Shared memory rings aren't supported on this platform");
+}
+
+bool SharedMemoryRing::write(const uint8_t *src, size_t bytes) {
+	throw logic_error("Shared memory rings aren't supported on this platform");
+}
+
+void SharedMemoryRing::close_read() {}
+void SharedMemoryRing::close_write() {}
+void SharedMemoryRing::set_reader_pid(pid_t) {}
+void SharedMemoryRing::set_writer_pid(pid_t) {}
+
+#endif
+
+SharedMemoryPipe::SharedMemoryPipe(): SharedMemoryPipe(SharedMemoryRing::create()) {
+}
+
+// both ends of the pipe are descriptors for the same memfd; each process only uses one end
+SharedMemoryPipe::SharedMemoryPipe(int fd): UnidirectionalPipe(fd, fcntl(fd, F_DUPFD_CLOEXEC, 0)), ring(fd) {
+}
+
+void SharedMemoryPipe::started_reader(pid_t pid) {
+	ring.set_reader_pid(pid);
+}
+
+void SharedMemoryPipe::started_writer(pid_t pid) {
+	ring.set_writer_pid(pid);
+}
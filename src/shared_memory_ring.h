@@ -0,0 +1,66 @@
+#ifndef SHARED_MEMORY_RING_H
+#define SHARED_MEMORY_RING_H
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/types.h>
+
+#include "unidirectional_pipe.h"
+
+struct SharedMemoryRingHeader;
+
+// a single-producer, single-consumer byte ring in a sealed memfd, which two processes on the same host can use
+// instead of a pipe so that the data doesn't have to be copied into and back out of the kernel.  neither end
+// makes a system call unless it has to wait for the other end (or wake it up).  there's no kernel object that
+// tells us if the process at the other end dies, so ks records the process IDs using each end of the ring and
+// a waiting process checks periodically that the other one is still running.
+class SharedMemoryRing {
+public:
+	static const size_t DEFAULT_CAPACITY = 1024*1024;
+
+	static bool supported();
+	static int create(size_t capacity = DEFAULT_CAPACITY); // returns a new descriptor for the memfd
+	static bool is_ring(int fd); // true if the descriptor is a memfd created by create()
+
+	SharedMemoryRing(int fd);
+	~SharedMemoryRing();
+
+	// waits until at least one byte is available, then reads as many as are available up to max_bytes, and
+	// returns the number read; returns 0 if the writer has closed (or died) and everything has been read.
+	size_t read(uint8_t *dest, size_t max_bytes);
+
+	// writes all the given bytes, waiting for space as necessary; returns false if the reader has closed (or died).
+	bool write(const uint8_t *src, size_t bytes);
+
+	void close_read();
+	void close_write();
+
+	void set_reader_pid(pid_t pid);
+	void set_writer_pid(pid_t pid);
+
+private:
+	SharedMemoryRingHeader *header;
+	uint8_t *data;
+	size_t capacity;
+	size_t mapped_size;
+
+	// forbid copying
+	SharedMemoryRing(const SharedMemoryRing& copy_from);
+};
+
+// presents a new shared memory ring as a UnidirectionalPipe so that it can be handed to Process::fork_and_exec and
+// attached to descriptors in the same way; FDReadStream and FDWriteStream detect that they've been given a ring.
+class SharedMemoryPipe: public UnidirectionalPipe {
+public:
+	SharedMemoryPipe();
+
+	virtual void started_reader(pid_t pid);
+	virtual void started_writer(pid_t pid);
+
+private:
+	SharedMemoryPipe(int fd);
+
+	SharedMemoryRing ring;
+};
+
+#endif
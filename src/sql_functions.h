@@ -10,64 +10,123 @@
 using namespace std;
 
 template <typename DatabaseClient>
-string columns_list(DatabaseClient &client, const Columns &columns, const ColumnIndices &column_indices) {
+void append_columns_list(DatabaseClient &client, const Columns &columns, const ColumnIndices &column_indices, string &result) {
 	if (column_indices.empty()) {
-		return "(NULL)";
+		result += "(NULL)";
+		return;
 	}
 
-	string result("(");
-	result += client.quote_identifiers_with();
-	result += columns[*column_indices.begin()].name;
-	result += client.quote_identifiers_with();
-	for (ColumnIndices::const_iterator column_index = column_indices.begin() + 1; column_index != column_indices.end(); ++column_index) {
-		result += ", ";
+	result += '(';
+	for (ColumnIndices::const_iterator column_index = column_indices.begin(); column_index != column_indices.end(); ++column_index) {
+		if (column_index != column_indices.begin()) {
+			result += ", ";
+		}
 		result += client.quote_identifiers_with();
 		result += columns[*column_index].name;
 		result += client.quote_identifiers_with();
 	}
-	result += ")";
+	result += ')';
+}
+
+template <typename DatabaseClient>
+string columns_list(DatabaseClient &client, const Columns &columns, const ColumnIndices &column_indices) {
+	string result;
+	append_columns_list(client, columns, column_indices, result);
 	return result;
 }
 
 template <typename DatabaseClient>
-string values_list(DatabaseClient &client, const Table &table, const ColumnValues &values) {
+void append_values_list(DatabaseClient &client, const Table &table, const ColumnValues &values, string &result) {
 	if (values.empty()) {
-		return "(NULL)";
+		result += "(NULL)";
+		return;
 	}
 
-	string result("(");
+	result += '(';
 	for (size_t n = 0; n < table.primary_key_columns.size(); n++) {
 		if (n > 0) {
 			result += ',';
 		}
-		result += encode(client, table.columns[table.primary_key_columns[n]], values[n]);
+		append_encoded(client, table.columns[table.primary_key_columns[n]], values[n], result);
 	}
-	result += ")";
-	return result;
+	result += ')';
 }
 
 template <typename DatabaseClient>
-string where_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const string &extra_where_conditions = "", const char *prefix = " WHERE ") {
-	string key_columns(columns_list(client, table.columns, table.primary_key_columns));
+string values_list(DatabaseClient &client, const Table &table, const ColumnValues &values) {
 	string result;
+	append_values_list(client, table, values, result);
+	return result;
+}
+
+template <typename DatabaseClient>
+void append_where_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, string &result, const string &extra_where_conditions = "", const char *prefix = " WHERE ") {
 	if (!prev_key.empty()) {
 		result += prefix;
-		result += key_columns;
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
 		result += " > ";
-		result += values_list(client, table, prev_key);
+		append_values_list(client, table, prev_key, result);
 		prefix = " AND ";
 	}
 	if (!last_key.empty()) {
 		result += prefix;
-		result += key_columns;
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
 		result += " <= ";
-		result += values_list(client, table, last_key);
+		append_values_list(client, table, last_key, result);
 		prefix = " AND ";
 	}
 	if (!extra_where_conditions.empty()) {
 		result += prefix;
 		result += extra_where_conditions;
 	}
+}
+
+// as append_values_list, but for prepared statements, which are given the key values as parameters; count
+// parameters are used, numbered from first_parameter
+template <typename DatabaseClient>
+void append_parameters_list(DatabaseClient &client, size_t count, size_t first_parameter, string &result) {
+	result += '(';
+	for (size_t n = 0; n < count; n++) {
+		if (n > 0) {
+			result += ',';
+		}
+		client.append_parameter_placeholder_to(result, first_parameter + n);
+	}
+	result += ')';
+}
+
+// as append_where_sql, but for prepared statements; the parameters for prev_key (if given) come first, then those
+// for last_key (if given).  returns the number of parameters used.
+template <typename DatabaseClient>
+size_t append_parameterized_where_sql(DatabaseClient &client, const Table &table, bool prev_key_given, bool last_key_given, string &result, const string &extra_where_conditions = "", const char *prefix = " WHERE ") {
+	size_t parameters = 0;
+	if (prev_key_given) {
+		result += prefix;
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
+		result += " > ";
+		append_parameters_list(client, table.primary_key_columns.size(), parameters + 1, result);
+		parameters += table.primary_key_columns.size();
+		prefix = " AND ";
+	}
+	if (last_key_given) {
+		result += prefix;
+		append_columns_list(client, table.columns, table.primary_key_columns, result);
+		result += " <= ";
+		append_parameters_list(client, table.primary_key_columns.size(), parameters + 1, result);
+		parameters += table.primary_key_columns.size();
+		prefix = " AND ";
+	}
+	if (!extra_where_conditions.empty()) {
+		result += prefix;
+		result += extra_where_conditions;
+	}
+	return parameters;
+}
+
+template <typename DatabaseClient>
+string where_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const string &extra_where_conditions = "", const char *prefix = " WHERE ") {
+	string result;
+	append_where_sql(client, table, prev_key, last_key, result, extra_where_conditions, prefix);
 	return result;
 }
 
@@ -90,26 +149,63 @@ string select_columns_sql(DatabaseClient &client, const Table &table) {
 const ssize_t NO_ROW_COUNT_LIMIT = -1;
 
 template <typename DatabaseClient>
-string retrieve_rows_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count = NO_ROW_COUNT_LIMIT) {
-	string key_columns(columns_list(client, table.columns, table.primary_key_columns));
+void append_order_by_primary_key_sql(DatabaseClient &client, const Table &table, string &result) {
+	result += " ORDER BY ";
+	size_t key_columns_start = result.size();
+	append_columns_list(client, table.columns, table.primary_key_columns, result);
+	result.erase(result.size() - 1).erase(key_columns_start, 1); // take off the brackets
+}
 
+template <typename DatabaseClient>
+string retrieve_rows_sql(DatabaseClient &client, const Table &table, const string &select_columns, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count = NO_ROW_COUNT_LIMIT) {
 	string result("SELECT ");
-	result += select_columns_sql(client, table);
+	result += select_columns;
 	result += " FROM ";
 	result += table.name;
-	result += where_sql(client, table, prev_key, last_key, table.where_conditions);
-	result += " ORDER BY " + key_columns.substr(1, key_columns.size() - 2);
+	append_where_sql(client, table, prev_key, last_key, result, table.where_conditions);
+	append_order_by_primary_key_sql(client, table, result);
 	if (row_count != NO_ROW_COUNT_LIMIT) {
-		result += " LIMIT " + to_string(row_count);
+		result += " LIMIT ";
+		append_integer(result, row_count);
 	}
 	return result;
 }
 
+// the parameterized form of retrieve_rows_sql, for clients that prepare the statements; the row count limit, if
+// any, is given as the last parameter
+template <typename DatabaseClient>
+string parameterized_retrieve_rows_sql(DatabaseClient &client, const Table &table, const string &select_columns, bool prev_key_given, bool last_key_given, bool row_count_given) {
+	string result("SELECT ");
+	result += select_columns;
+	result += " FROM ";
+	result += table.name;
+	size_t parameters = append_parameterized_where_sql(client, table, prev_key_given, last_key_given, result, table.where_conditions);
+	append_order_by_primary_key_sql(client, table, result);
+	if (row_count_given) {
+		result += " LIMIT ";
+		client.append_parameter_placeholder_to(result, parameters + 1);
+	}
+	return result;
+}
+
+template <typename DatabaseClient>
+string retrieve_rows_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, ssize_t row_count = NO_ROW_COUNT_LIMIT) {
+	return retrieve_rows_sql(client, table, select_columns_sql(client, table), prev_key, last_key, row_count);
+}
+
 template <typename DatabaseClient>
 string count_rows_sql(DatabaseClient &client, const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key) {
 	string result("SELECT COUNT(*) FROM ");
 	result += table.name;
-	result += where_sql(client, table, prev_key, last_key, table.where_conditions);
+	append_where_sql(client, table, prev_key, last_key, result, table.where_conditions);
+	return result;
+}
+
+template <typename DatabaseClient>
+string parameterized_count_rows_sql(DatabaseClient &client, const Table &table, bool prev_key_given, bool last_key_given) {
+	string result("SELECT COUNT(*) FROM ");
+	result += table.name;
+	append_parameterized_where_sql(client, table, prev_key_given, last_key_given, result, table.where_conditions);
 	return result;
 }
 
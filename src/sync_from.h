@@ -1,9 +1,18 @@
+#include <list>
+
 #include "command.h"
 #include "schema_serialization.h"
 #include "filters.h"
 #include "fdstream.h"
 #include "hash_algorithm.h"
+#include "rows_encoding.h"
+#include "rows_dictionary.h"
+#include "columnar_batch.h"
 #include "sync_algorithm.h"
+#include "key_cache.h"
+#include "database_client_traits.h"
+
+const size_t MAX_PING_BYTES = 1024*1024;
 
 template<class DatabaseClient>
 struct SyncFromWorker {
@@ -22,7 +31,12 @@ struct SyncFromWorker {
 			protocol_version(0),
 			target_minimum_block_size(1),
 			target_maximum_block_size(DEFAULT_MAXIMUM_BLOCK_SIZE),
-			hash_algorithm(hash_algorithm) {
+			hash_algorithm(hash_algorithm),
+			rows_encoding(RowsEncoding::plain),
+			columnar_packer(output) {
+		out.cork();
+		in.flush_when_blocking(out);
+
 		if (!set_variables.empty()) {
 			client.execute("SET " + set_variables);
 		}
@@ -93,6 +107,18 @@ struct SyncFromWorker {
 						handle_hash_algorithm_command();
 						break;
 
+					case Commands::KEY_CACHE_SIZE:
+						handle_key_cache_size_command();
+						break;
+
+					case Commands::PING:
+						handle_ping_command();
+						break;
+
+					case Commands::ROWS_ENCODING:
+						handle_rows_encoding_command();
+						break;
+
 					case Commands::QUIT:
 						read_all_arguments(input);
 						return;
@@ -101,6 +127,8 @@ struct SyncFromWorker {
 						throw command_error("Unknown command " + to_string(verb));
 				}
 
+				// normally a no-op since we're corked, but sends what we have if it's been waiting a while; we'll
+				// otherwise send it out when we next need to wait for the other end to send us a command
 				output.flush();
 			}
 		} catch (const exception &e) {
@@ -115,6 +143,7 @@ struct SyncFromWorker {
 		read_all_arguments(input, table_name);
 		const Table *table = tables_by_name.at(table_name); // throws out_of_range if not present in the map
 		show_status("syncing " + table_name);
+		key_cache.clear();
 		hash_first_range(*this, *table, target_minimum_block_size);
 		return table;
 	}
@@ -123,7 +152,7 @@ struct SyncFromWorker {
 		if (!table) throw command_error("Expected a table command before hash command");
 		ColumnValues prev_key, last_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), hash);
 		check_hash_and_choose_next_range(*this, *table, nullptr, prev_key, last_key, nullptr, hash, target_minimum_block_size, target_maximum_block_size);
 	}
 
@@ -131,14 +160,14 @@ struct SyncFromWorker {
 		if (!table) throw command_error("Expected a table command before hash command");
 		ColumnValues prev_key, last_key, failed_last_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, failed_last_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(failed_last_key), hash);
 		check_hash_and_choose_next_range(*this, *table, nullptr, prev_key, last_key, &failed_last_key, hash, target_minimum_block_size, target_maximum_block_size);
 	}
 
 	void handle_rows_command(const Table *table) {
 		if (!table) throw command_error("Expected a table command before rows command");
 		ColumnValues prev_key, last_key;
-		read_all_arguments(input, prev_key, last_key);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key));
 		send_rows_command(*table, prev_key, last_key);
 	}
 
@@ -146,7 +175,7 @@ struct SyncFromWorker {
 		if (!table) throw command_error("Expected a table command before rows+hash next command");
 		ColumnValues prev_key, last_key, next_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, next_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(next_key), hash);
 		check_hash_and_choose_next_range(*this, *table, &prev_key, last_key, next_key, nullptr, hash, target_minimum_block_size, target_maximum_block_size);
 	}
 
@@ -154,7 +183,7 @@ struct SyncFromWorker {
 		if (!table) throw command_error("Expected a table command before rows+hash fail command");
 		ColumnValues prev_key, last_key, next_key, failed_last_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, next_key, failed_last_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(next_key), key_cache.receiving(failed_last_key), hash);
 		check_hash_and_choose_next_range(*this, *table, &prev_key, last_key, next_key, &failed_last_key, hash, target_minimum_block_size, target_maximum_block_size);
 	}
 
@@ -200,37 +229,80 @@ struct SyncFromWorker {
 		send_command(output, Commands::HASH_ALGORITHM, hash_algorithm); // we always accept the requested algorithm and send it back (but maybe one day we won't)
 	}
 
+	void handle_key_cache_size_command() {
+		size_t key_cache_size;
+		read_all_arguments(input, key_cache_size);
+		key_cache_size = min(key_cache_size, MAX_KEY_CACHE_SIZE);
+		key_cache.resize(key_cache_size);
+		send_command(output, Commands::KEY_CACHE_SIZE, key_cache_size); // we accept any size up to the limit that keeps references to a single byte
+	}
+
+	void handle_ping_command() {
+		size_t bytes;
+		read_all_arguments(input, bytes);
+		send_command(output, Commands::PING, string(min(bytes, MAX_PING_BYTES), '\0')); // the other end uses the response to measure the link
+		out.force_flush(); // don't let coalescing add to the time measured
+	}
+
+	void handle_rows_encoding_command() {
+		read_all_arguments(input, rows_encoding);
+		if (rows_encoding != RowsEncoding::dictionary && rows_encoding != RowsEncoding::columnar) rows_encoding = RowsEncoding::plain;
+		send_command(output, Commands::ROWS_ENCODING, rows_encoding); // we use any encoding we know, and tell the other end if we've fallen back to plain
+	}
+
 	inline void send_hash_next_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const string &hash) {
-		send_command(output, Commands::HASH_NEXT, prev_key, last_key, hash);
+		send_command(output, Commands::HASH_NEXT, key_cache.sending(prev_key), key_cache.sending(last_key), hash);
 	}
 
 	inline void send_hash_fail_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &failed_last_key, const string &hash) {
-		send_command(output, Commands::HASH_FAIL, prev_key, last_key, failed_last_key, hash);
+		send_command(output, Commands::HASH_FAIL, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(failed_last_key), hash);
 	}
 
 	inline void send_rows_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key) {
-		send_command_begin(output, Commands::ROWS, prev_key, last_key);
+		send_command_begin(output, Commands::ROWS, key_cache.sending(prev_key), key_cache.sending(last_key));
 		send_rows(table, prev_key, last_key);
 		send_command_end(output);
 	}
 
 	inline void send_rows_and_hash_next_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &next_key, const string &hash) {
-		send_command_begin(output, Commands::ROWS_AND_HASH_NEXT, prev_key, last_key, next_key, hash);
+		send_command_begin(output, Commands::ROWS_AND_HASH_NEXT, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(next_key), hash);
 		send_rows(table, prev_key, last_key);
 		send_command_end(output);
 	}
 
 	inline void send_rows_and_hash_fail_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &next_key, const ColumnValues &failed_last_key, const string &hash) {
-		send_command_begin(output, Commands::ROWS_AND_HASH_FAIL, prev_key, last_key, next_key, failed_last_key, hash);
+		send_command_begin(output, Commands::ROWS_AND_HASH_FAIL, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(next_key), key_cache.sending(failed_last_key), hash);
 		send_rows(table, prev_key, last_key);
 		send_command_end(output);
 	}
 
-	void send_rows(const Table &table, ColumnValues prev_key, const ColumnValues &last_key) {
+	void send_rows(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key) {
+		if (rows_encoding == RowsEncoding::dictionary) {
+			// each response starts a new dictionary
+			rows_dictionary.clear();
+			DictionaryEncodingPacker<FDWriteStream> dictionary_packer(output, rows_dictionary);
+			send_rows(table, prev_key, last_key, dictionary_packer);
+		} else if (rows_encoding == RowsEncoding::columnar) {
+			send_rows(table, prev_key, last_key, columnar_packer);
+			columnar_packer.flush();
+		} else {
+			send_rows(table, prev_key, last_key, output);
+		}
+	}
+
+	template <typename RowsPacker>
+	void send_rows(const Table &table, ColumnValues prev_key, const ColumnValues &last_key, RowsPacker &packer) {
 		// we limit individual queries to an arbitrary limit of 10000 rows, to reduce annoying slow
 		// queries that would otherwise be logged on the server and reduce buffering.
 		const int BATCH_SIZE = 10000;
-		RowPackerAndLastKey<FDWriteStream> row_packer(output, table.primary_key_columns);
+		RowPackerAndLastKey<RowsPacker> row_packer(packer, table.primary_key_columns);
+
+		// but databases that support COPY can send the whole of the rest of the table with a single statement,
+		// which is much faster than retrieving it in batches, each of which has to seek to its start
+		if (last_key.empty() && is_base_of<SupportsCopy, DatabaseClient>::value) {
+			client.retrieve_rows(row_packer, table, prev_key, last_key);
+			return;
+		}
 
 		while (true) {
 			client.retrieve_rows(row_packer, table, prev_key, last_key, BATCH_SIZE);
@@ -242,7 +314,7 @@ struct SyncFromWorker {
 
 	void negotiate_protocol_version() {
 		const int EARLIEST_PROTOCOL_VERSION_SUPPORTED = 5;
-		const int LATEST_PROTOCOL_VERSION_SUPPORTED = 6;
+		const int LATEST_PROTOCOL_VERSION_SUPPORTED = 10;
 
 		// all conversations must start with a Commands::PROTOCOL command to establish the language to be used
 		int their_protocol_version;
@@ -256,7 +328,10 @@ struct SyncFromWorker {
 	}
 
 	void populate_database_schema() {
-		client.populate_database_schema(database);
+		// older versions of the other end expect the partitions of PostgreSQL tables to be listed as tables of their
+		// own, and would drop them if we didn't (see SyncToWorker::partitions_supported)
+		const int EARLIEST_PARTITIONS_PROTOCOL_VERSION_SUPPORTED = 10;
+		client.populate_database_schema(database, protocol_version >= EARLIEST_PARTITIONS_PROTOCOL_VERSION_SUPPORTED);
 
 		for (Table &table : database.tables) {
 			tables_by_name[table.name] = &table;
@@ -265,6 +340,14 @@ struct SyncFromWorker {
 		if (!filter_file.empty()) {
 			load_filters(filter_file, tables_by_name);
 		}
+
+		// the other end may open the partitions of a partitioned table separately, by the names we gave in the schema
+		for (const Table &table : database.tables) {
+			for (const Partition &partition : table.partitions) {
+				partition_tables.push_back(table.partition_table(partition));
+				tables_by_name[partition.name] = &partition_tables.back();
+			}
+		}
 	}
 
 	void show_status(string message) {
@@ -274,6 +357,7 @@ struct SyncFromWorker {
 
 	DatabaseClient client;
 	Database database;
+	list<Table> partition_tables;
 	map<string, Table*> tables_by_name;
 	string filter_file;
 	FDReadStream in;
@@ -287,6 +371,10 @@ struct SyncFromWorker {
 	size_t target_minimum_block_size;
 	size_t target_maximum_block_size;
 	HashAlgorithm hash_algorithm;
+	RowsEncoding rows_encoding;
+	RowsDictionaryEncoder rows_dictionary;
+	ColumnarBatchPacker<FDWriteStream> columnar_packer;
+	KeyCache key_cache;
 };
 
 template<class DatabaseClient, typename... Options>
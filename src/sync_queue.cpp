@@ -1,9 +1,16 @@
 #include "sync_queue.h"
 
-void SyncQueue::enqueue(const Tables &tables) {
+void SyncQueue::enqueue(const Table &table) {
 	unique_lock<std::mutex> lock(mutex);
-	for (const Table &from_table : tables) {
-		queue.push_back(&from_table);
+	queue.push_back(&table);
+}
+
+void SyncQueue::enqueue_partitions(const Table &table) {
+	// each partition is queued as a table of its own, so that the workers can sync them concurrently
+	unique_lock<std::mutex> lock(mutex);
+	for (const Partition &partition : table.partitions) {
+		partition_tables.push_back(table.partition_table(partition));
+		queue.push_back(&partition_tables.back());
 	}
 }
 
@@ -13,10 +13,12 @@ using namespace std;
 struct SyncQueue: public AbortableBarrier {
 	SyncQueue(size_t workers): AbortableBarrier(workers) {}
 
-	void enqueue(const Tables &tables);
+	void enqueue(const Table &table);
+	void enqueue_partitions(const Table &table);
 	const Table* pop();
 	
 	list<const Table*> queue;
+	list<Table> partition_tables;
 	string snapshot;
 };
 
@@ -1,20 +1,30 @@
 #include "command.h"
 #include "commit_level.h"
 #include "hash_algorithm.h"
+#include "rows_encoding.h"
 #include "sync_algorithm.h"
 #include "schema_functions.h"
 #include "schema_matcher.h"
 #include "sync_queue.h"
 #include "row_range_applier.h"
+#include "merge_row_range_applier.h"
 #include "reset_table_sequences.h"
 #include "fdstream.h"
+#include "read_ahead_stream.h"
+#include "key_cache.h"
 #include <boost/algorithm/string.hpp>
 #include <thread>
+#include <chrono>
 
 using namespace std;
 
 #define VERY_VERBOSE 2
 
+const size_t MAX_BYTES_TO_READ_AHEAD = 16*1024*1024; // no particular rationale for this value, same as RowRangeApplier's buffer size
+const int LINK_PROBE_ROUND_TRIPS = 3;
+const size_t LINK_PROBE_BYTES = 256*1024; // enough to get a rough idea of throughput without delaying startup noticeably on slow links
+const size_t MAXIMUM_PROBED_MINIMUM_BLOCK_SIZE = 16*1024*1024; // so that one bad measurement can't stop us subdividing ranges
+
 template <typename DatabaseClient>
 struct SyncToWorker {
 	SyncToWorker(
@@ -22,13 +32,14 @@ struct SyncToWorker {
 		const string &database_host, const string &database_port, const string &database_name, const string &database_username, const string &database_password,
 		const string &set_variables, const set<string> &ignore_tables, const set<string> &only_tables,
 		int verbose, bool progress, bool snapshot, bool alter, CommitLevel commit_level, HashAlgorithm hash_algorithm,
-    bool structure_only) :
+    RowsEncoding rows_encoding, bool structure_only, bool fast_apply) :
 			database(database),
 			sync_queue(sync_queue),
 			leader(leader),
 			input_stream(read_from_descriptor),
+			read_ahead_stream(input_stream, MAX_BYTES_TO_READ_AHEAD),
 			output_stream(write_to_descriptor),
-			input(input_stream),
+			input(read_ahead_stream),
 			output(output_stream),
 			client(database_host, database_port, database_name, database_username, database_password),
 			ignore_tables(ignore_tables),
@@ -40,7 +51,11 @@ struct SyncToWorker {
 			commit_level(commit_level),
 			hash_algorithm(hash_algorithm),
 			structure_only(structure_only),
+			fast_apply(fast_apply),
+			rows_encoding(rows_encoding),
 			protocol_version(0),
+			link_round_trip_time(0),
+			link_bytes_per_second(0),
 			target_minimum_block_size(1),
 			target_maximum_block_size(DEFAULT_MAXIMUM_BLOCK_SIZE),
 			worker_thread(std::ref(*this)) {
@@ -54,10 +69,17 @@ struct SyncToWorker {
 	}
 
 	void operator()() {
+		// coalesce the commands we send, flushing when we need to wait for a response
+		output_stream.cork();
+		read_ahead_stream.flush_when_blocking(output_stream);
+
 		try {
 			negotiate_protocol();
+			probe_link();
 			negotiate_target_minimum_block_size();
 			negotiate_hash_algorithm();
+			negotiate_key_cache_size();
+			negotiate_rows_encoding();
 
 			share_snapshot();
 			retrieve_database_schema();
@@ -91,7 +113,7 @@ struct SyncToWorker {
 
 	void negotiate_protocol() {
 		const int EARLIEST_PROTOCOL_VERSION_SUPPORTED = 5;
-		const int LATEST_PROTOCOL_VERSION_SUPPORTED = 6;
+		const int LATEST_PROTOCOL_VERSION_SUPPORTED = 10;
 
 		// tell the other end what version of the protocol we can speak, and have them tell us which version we're able to converse in
 		send_command(output, Commands::PROTOCOL, LATEST_PROTOCOL_VERSION_SUPPORTED);
@@ -105,8 +127,50 @@ struct SyncToWorker {
 		}
 	}
 
+	void probe_link() {
+		const int EARLIEST_PING_PROTOCOL_VERSION_SUPPORTED = 8;
+
+		if (protocol_version < EARLIEST_PING_PROTOCOL_VERSION_SUPPORTED) return;
+
+		// the first few round trips tell us the latency; take the best, since the others may include startup noise
+		for (int round_trip = 0; round_trip < LINK_PROBE_ROUND_TRIPS; round_trip++) {
+			chrono::microseconds elapsed(ping(0));
+			if (!round_trip || elapsed < link_round_trip_time) link_round_trip_time = elapsed;
+		}
+
+		// then we ask for a reasonably big response; whatever time it takes beyond the round trip was spent transferring it
+		chrono::microseconds transfer_time(ping(LINK_PROBE_BYTES) - link_round_trip_time);
+		link_bytes_per_second = LINK_PROBE_BYTES*1000000/max<chrono::microseconds::rep>(transfer_time.count(), 1);
+
+		if (verbose) {
+			unique_lock<mutex> lock(sync_queue.mutex);
+			cout << "link round trip time " << link_round_trip_time.count()/1000.0 << "ms, throughput " << link_bytes_per_second/1048576.0 << "MB/s" << endl << flush;
+		}
+	}
+
+	chrono::microseconds ping(size_t bytes) {
+		chrono::steady_clock::time_point started = chrono::steady_clock::now();
+		string response;
+		send_command(output, Commands::PING, bytes);
+		read_expected_command(input, Commands::PING, response); // the read forces our output to be flushed
+		return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started);
+	}
+
+	size_t link_bandwidth_delay_product() {
+		return link_bytes_per_second*link_round_trip_time.count()/1000000;
+	}
+
 	void negotiate_target_minimum_block_size() {
-		send_command(output, Commands::TARGET_BLOCK_SIZE, DEFAULT_MINIMUM_BLOCK_SIZE);
+		// we want ranges to be big enough that the time we spend waiting for the other end to reply to our
+		// commands is small compared to the time spent transferring the rows, so if we were able to measure the
+		// link, ask for blocks of at least as much data as it can have in flight.
+		size_t target_minimum_block_size_wanted = max(DEFAULT_MINIMUM_BLOCK_SIZE, min(link_bandwidth_delay_product(), MAXIMUM_PROBED_MINIMUM_BLOCK_SIZE));
+		if (verbose && target_minimum_block_size_wanted != DEFAULT_MINIMUM_BLOCK_SIZE) {
+			unique_lock<mutex> lock(sync_queue.mutex);
+			cout << "using minimum block size " << target_minimum_block_size_wanted << " bytes" << endl << flush;
+		}
+
+		send_command(output, Commands::TARGET_BLOCK_SIZE, target_minimum_block_size_wanted);
 
 		// the real app always accepts the block size we request, but the test suite uses smaller block sizes to make it easier to set up different scenarios
 		read_expected_command(input, Commands::TARGET_BLOCK_SIZE, target_minimum_block_size);
@@ -123,6 +187,28 @@ struct SyncToWorker {
 		}
 	}
 
+	void negotiate_key_cache_size() {
+		const int EARLIEST_KEY_CACHE_PROTOCOL_VERSION_SUPPORTED = 7;
+
+		if (protocol_version >= EARLIEST_KEY_CACHE_PROTOCOL_VERSION_SUPPORTED) {
+			size_t key_cache_size = DEFAULT_KEY_CACHE_SIZE;
+			send_command(output, Commands::KEY_CACHE_SIZE, key_cache_size);
+			read_expected_command(input, Commands::KEY_CACHE_SIZE, key_cache_size);
+			key_cache.resize(key_cache_size);
+		}
+	}
+
+	void negotiate_rows_encoding() {
+		const int EARLIEST_ROWS_ENCODING_PROTOCOL_VERSION_SUPPORTED = 9;
+
+		if (protocol_version >= EARLIEST_ROWS_ENCODING_PROTOCOL_VERSION_SUPPORTED) {
+			send_command(output, Commands::ROWS_ENCODING, rows_encoding);
+			read_expected_command(input, Commands::ROWS_ENCODING, rows_encoding); // the other end may fall back to plain
+		} else {
+			rows_encoding = RowsEncoding::plain;
+		}
+	}
+
 	void share_snapshot() {
 		if (sync_queue.workers > 1 && snapshot) {
 			// although some databases (such as postgresql) can share & adopt snapshots with no penalty
@@ -174,9 +260,19 @@ struct SyncToWorker {
 		if (leader) {
 			// get our schema
 			Database to_database;
-			client.populate_database_schema(to_database);
+			client.populate_database_schema(to_database, partitions_supported());
 			filter_tables(to_database.tables);
 
+			// we can only sync the partitions of a table separately if the table and its partitions are the same
+			// at both ends, so that each row belongs in the same partition at both ends
+			TableFinder to_tables(to_database.tables);
+			for (Table &table : database.tables) {
+				const Table *to_table = to_tables.find(table.name);
+				if (!to_table || *to_table != table || to_table->partitions != table.partitions) {
+					table.partitions.clear();
+				}
+			}
+
 			// check they match, and if not, figure out what DDL we would need to run to fix the 'to' end's schema
 			SchemaMatcher<DatabaseClient> matcher(client);
 
@@ -217,7 +313,13 @@ struct SyncToWorker {
 	void enqueue_tables() {
 		// queue up all the tables
 		if (leader) {
-			sync_queue.enqueue(database.tables);
+			for (const Table &table : database.tables) {
+				if (sync_partitions_separately(table)) {
+					sync_queue.enqueue_partitions(table);
+				} else {
+					sync_queue.enqueue(table);
+				}
+			}
 		}
 
 		// wait for the leader to do that (a barrier here is slightly excessive as we don't care if the other
@@ -225,8 +327,27 @@ struct SyncToWorker {
 		sync_queue.wait_at_barrier();
 	}
 
+	bool partitions_supported() {
+		const int EARLIEST_PARTITIONS_PROTOCOL_VERSION_SUPPORTED = 10;
+
+		// older versions list the partitions of PostgreSQL tables as tables of their own, so we must list ours the
+		// same way to match, and they don't support querying each partition directly by the name given in the schema
+		return (protocol_version >= EARLIEST_PARTITIONS_PROTOCOL_VERSION_SUPPORTED);
+	}
+
+	bool sync_partitions_separately(const Table &table) {
+		// sequences need to be reset from the values in the whole table, so we don't split tables that have them.
+		return (partitions_supported() &&
+			!table.partitions.empty() &&
+			!ResetTableSequences<DatabaseClient>::required(table));
+	}
+
 	void sync_tables() {
 		client.disable_referential_integrity();
+		if (fast_apply) {
+			string changes(client.enable_fast_apply(database));
+			if (verbose && leader) cout << "fast apply: " << changes << endl;
+		}
 
 		while (true) {
 			// grab the next table to work on from the queue (blocking if it's empty)
@@ -249,6 +370,7 @@ struct SyncToWorker {
 
 		// wait for all workers to finish their tables
 		sync_queue.wait_at_barrier();
+		if (fast_apply) client.disable_fast_apply();
 		client.enable_referential_integrity();
 	}
 
@@ -265,6 +387,7 @@ struct SyncToWorker {
 			cout << "starting " << table.name << endl << flush;
 		}
 
+		key_cache.clear();
 		send_command(output, Commands::OPEN, table.name);
 
 		while (!finished) {
@@ -332,7 +455,7 @@ struct SyncToWorker {
 		// the last hash we sent them matched, and so they've moved on to the next set of rows and sent us the hash
 		ColumnValues prev_key, last_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), hash);
 		if (verbose >= VERY_VERBOSE) cout << "-> hash " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << endl;
 
 		// after each hash command received it's our turn to send the next command
@@ -344,7 +467,7 @@ struct SyncToWorker {
 		// the hash for a smaller set of rows (but not so small that they sent back the data instead)
 		ColumnValues prev_key, last_key, failed_last_key;
 		string hash;
-		read_all_arguments(input, prev_key, last_key, failed_last_key, hash);
+		read_all_arguments(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(failed_last_key), hash);
 		if (verbose >= VERY_VERBOSE) cout << "-> hash " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " last-failure " << values_list(client, table, failed_last_key) << endl;
 
 		// after each hash command received it's our turn to send the next command
@@ -352,14 +475,15 @@ struct SyncToWorker {
 	}
 
 	bool handle_rows_command(const Table &table, RowReplacer<DatabaseClient> &row_replacer) {
-		// we're being sent a range of rows; apply them to our end.  we do this in-context to
-		// provide flow control - if we buffered and used a separate apply thread, we would
-		// bloat up if this end couldn't write to disk as quickly as the other end sent data.
+		// we're being sent a range of rows; apply them to our end.  we do this in-context; the
+		// read-ahead stream decodes rows ahead of us so we don't wait for the network, but its
+		// queue is bounded so we still provide flow control if this end can't write to disk as
+		// quickly as the other end sends data.
 		ColumnValues prev_key, last_key;
-		read_array(input, prev_key, last_key); // the first array gives the range arguments, which is followed by one array for each row
+		read_array(input, key_cache.receiving(prev_key), key_cache.receiving(last_key)); // the first array gives the range arguments, which is followed by one array for each row
 		if (verbose >= VERY_VERBOSE) cout << "-> rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << endl;
 
-		RowRangeApplier<DatabaseClient>(row_replacer, table, prev_key, last_key).stream_from_input(input);
+		apply_rows(table, row_replacer, prev_key, last_key);
 
 		// if the range extends to the end of their table, that means we're done with this table;
 		// otherwise, rows commands are immediately followed by another command
@@ -370,7 +494,7 @@ struct SyncToWorker {
 		// combo of the above ROWS and HASH_NEXT commands
 		ColumnValues prev_key, last_key, next_key;
 		string hash;
-		read_array(input, prev_key, last_key, next_key, hash); // the first array gives the range arguments and hash, which is followed by one array for each row
+		read_array(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(next_key), hash); // the first array gives the range arguments and hash, which is followed by one array for each row
 		if (verbose >= VERY_VERBOSE) cout << "-> rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " +" << endl;
 		if (verbose >= VERY_VERBOSE) cout << "-> hash " << table.name << ' ' << values_list(client, table, last_key) << ' ' << values_list(client, table, next_key) << endl;
 
@@ -380,9 +504,11 @@ struct SyncToWorker {
 		// over the network at the same time as we are receiving rows.  we need to be able to
 		// fit the command we send back in the kernel send buffer to guarantee there is no
 		// deadlock; it's never been smaller than a page on any supported OS, and has been
-		// defaulted to much larger values for some years.
+		// defaulted to much larger values for some years.  since our output is corked, we
+		// need to flush explicitly here as we won't block for input until the rows are applied.
 		check_hash_and_choose_next_range(*this, table, nullptr, last_key, next_key, nullptr, hash, target_minimum_block_size, target_maximum_block_size);
-		RowRangeApplier<DatabaseClient>(row_replacer, table, prev_key, last_key).stream_from_input(input);
+		output_stream.force_flush();
+		apply_rows(table, row_replacer, prev_key, last_key);
 		// nb. it's implied last_key is not [], as we would have been sent back a plain rows command for the combined range if that was needed
 	}
 
@@ -390,40 +516,52 @@ struct SyncToWorker {
 		// combo of the above ROWS and HASH_FAIL commands
 		ColumnValues prev_key, last_key, next_key, failed_last_key;
 		string hash;
-		read_array(input, prev_key, last_key, next_key, failed_last_key, hash); // the first array gives the range arguments, which is followed by one array for each row
+		read_array(input, key_cache.receiving(prev_key), key_cache.receiving(last_key), key_cache.receiving(next_key), key_cache.receiving(failed_last_key), hash); // the first array gives the range arguments, which is followed by one array for each row
 		if (verbose >= VERY_VERBOSE) cout << "-> rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " +" << endl;
 		if (verbose >= VERY_VERBOSE) cout << "-> hash " << table.name << ' ' << values_list(client, table, last_key) << ' ' << values_list(client, table, next_key) << " last-failure " << values_list(client, table, failed_last_key) << endl;
 
 		// same pipelining as the previous case
 		check_hash_and_choose_next_range(*this, table, nullptr, last_key, next_key, &failed_last_key, hash, target_minimum_block_size, target_maximum_block_size);
-		RowRangeApplier<DatabaseClient>(row_replacer, table, prev_key, last_key).stream_from_input(input);
+		output_stream.force_flush();
+		apply_rows(table, row_replacer, prev_key, last_key);
+	}
+
+	void apply_rows(const Table &table, RowReplacer<DatabaseClient> &row_replacer, const ColumnValues &prev_key, const ColumnValues &last_key) {
+		rows_decoder.start(rows_encoding);
+
+		// if we know how the database orders the primary key, we can merge the source rows with ours as they arrive
+		if (KeyComparator::supported(table)) {
+			MergeRowRangeApplier<DatabaseClient>(row_replacer, table, prev_key, last_key).stream_from_input(input, rows_decoder);
+		} else {
+			RowRangeApplier<DatabaseClient>(row_replacer, row_arena, table, prev_key, last_key).stream_from_input(input, rows_decoder);
+		}
 	}
 
 	inline void send_hash_next_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const string &hash) {
 		if (verbose >= VERY_VERBOSE) cout << "<- hash " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << endl;
-		send_command(output, Commands::HASH_NEXT, prev_key, last_key, hash);
+		send_command(output, Commands::HASH_NEXT, key_cache.sending(prev_key), key_cache.sending(last_key), hash);
 	}
 
 	inline void send_hash_fail_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &failed_last_key, const string &hash) {
 		if (verbose >= VERY_VERBOSE) cout << "<- hash " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " last-failure " << values_list(client, table, failed_last_key) << endl;
-		send_command(output, Commands::HASH_FAIL, prev_key, last_key, failed_last_key, hash);
+		send_command(output, Commands::HASH_FAIL, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(failed_last_key), hash);
 	}
 
 	inline void send_rows_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key) {
 		if (verbose >= VERY_VERBOSE) cout << "<- rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << endl;
-		send_command(output, Commands::ROWS, prev_key, last_key);
+		send_command(output, Commands::ROWS, key_cache.sending(prev_key), key_cache.sending(last_key));
 	}
 
 	inline void send_rows_and_hash_next_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &next_key, const string &hash) {
 		if (verbose >= VERY_VERBOSE) cout << "<- rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " +" << endl;
 		if (verbose >= VERY_VERBOSE) cout << "<- hash " << table.name << ' ' << values_list(client, table, last_key) << ' ' << values_list(client, table, next_key) << endl;
-		send_command(output, Commands::ROWS_AND_HASH_NEXT, prev_key, last_key, next_key, hash);
+		send_command(output, Commands::ROWS_AND_HASH_NEXT, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(next_key), hash);
 	}
 
 	inline void send_rows_and_hash_fail_command(const Table &table, const ColumnValues &prev_key, const ColumnValues &last_key, const ColumnValues &next_key, const ColumnValues &failed_last_key, const string &hash) {
 		if (verbose >= VERY_VERBOSE) cout << "<- rows " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " +" << endl;
 		if (verbose >= VERY_VERBOSE) cout << "<- hash " << table.name << ' ' << values_list(client, table, prev_key) << ' ' << values_list(client, table, last_key) << " last-failure " << values_list(client, table, failed_last_key) << endl;
-		send_command(output, Commands::ROWS_AND_HASH_FAIL, prev_key, last_key, next_key, failed_last_key, hash);
+		send_command(output, Commands::ROWS_AND_HASH_FAIL, key_cache.sending(prev_key), key_cache.sending(last_key), key_cache.sending(next_key), key_cache.sending(failed_last_key), hash);
 	}
 
 	void commit() {
@@ -453,6 +591,7 @@ struct SyncToWorker {
 	void send_quit_command() {
 		try {
 			send_command(output, Commands::QUIT);
+			output_stream.force_flush();
 		} catch (const exception &e) {
 			// we don't care if sending this command fails itself, we're already past the point where we could abort anyway
 		}
@@ -463,7 +602,8 @@ struct SyncToWorker {
 	bool leader;
 	FDWriteStream output_stream;
 	FDReadStream input_stream;
-	Unpacker<FDReadStream> input;
+	ReadAheadStream<FDReadStream> read_ahead_stream;
+	Unpacker<ReadAheadStream<FDReadStream>> input;
 	Packer<FDWriteStream> output;
 	DatabaseClient client;
 	
@@ -476,10 +616,17 @@ struct SyncToWorker {
 	CommitLevel commit_level;
 	HashAlgorithm hash_algorithm;
 	bool structure_only;
+	bool fast_apply;
+	RowsEncoding rows_encoding;
 
 	int protocol_version;
+	chrono::microseconds link_round_trip_time;
+	size_t link_bytes_per_second;
 	size_t target_minimum_block_size;
 	size_t target_maximum_block_size;
+	KeyCache key_cache;
+	Arena row_arena; // used by RowRangeApplier for the rows it buffers, and kept so that we reuse its blocks
+	RowsDecoder rows_decoder;
 	std::thread worker_thread;
 };
 
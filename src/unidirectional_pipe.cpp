@@ -14,6 +14,14 @@ UnidirectionalPipe::UnidirectionalPipe() {
 	}
 }
 
+UnidirectionalPipe::UnidirectionalPipe(int read_handle, int write_handle) {
+	if (read_handle < 0 || write_handle < 0) {
+		throw runtime_error("Couldn't create a pipe: " + string(strerror(errno)));
+	}
+	pipe_handles[0] = read_handle;
+	pipe_handles[1] = write_handle;
+}
+
 UnidirectionalPipe::~UnidirectionalPipe() {
 	close_read();
 	close_write();
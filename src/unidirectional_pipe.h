@@ -1,9 +1,13 @@
+#ifndef UNIDIRECTIONAL_PIPE_H
+#define UNIDIRECTIONAL_PIPE_H
+
 #include <stdexcept>
+#include <sys/types.h>
 
 class UnidirectionalPipe {
 public:
 	UnidirectionalPipe();
-	~UnidirectionalPipe();
+	virtual ~UnidirectionalPipe();
 
 	int  read_fileno();
 	int write_fileno();
@@ -14,9 +18,18 @@ public:
 	void close_read();
 	void close_write();
 
+	// called once the processes using each end have been started
+	virtual void started_reader(pid_t) {}
+	virtual void started_writer(pid_t) {}
+
+protected:
+	UnidirectionalPipe(int read_handle, int write_handle);
+
 private:
 	int pipe_handles[2];
 
 	// forbid copying
 	UnidirectionalPipe(const UnidirectionalPipe& copy_from) { throw std::logic_error("copying forbidden"); }
 };
+
+#endif
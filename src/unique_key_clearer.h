@@ -10,17 +10,21 @@ struct UniqueKeyClearer {
 		client(&client),
 		table(&table),
 		key_columns(&key_columns),
+		encoders(table.columns),
 		delete_sql("DELETE FROM " + table.name + " WHERE (", ")") {
 	}
 
-	bool key_enforceable(const PackedRow &row) {
+	// row may be a PackedRow or a FlatRow
+	template <typename Row>
+	bool key_enforceable(const Row &row) {
 		for (size_t n = 0; n < key_columns->size(); n++) {
 			if (row[(*key_columns)[n]].is_nil()) return false;
 		}
 		return true;
 	}
 
-	void row(const PackedRow &row) {
+	template <typename Row>
+	void row(const Row &row) {
 		// rows with any NULL values won't enforce a uniqueness constraint, so we don't need to clear them
 		if (!key_enforceable(row)) return;
 
@@ -33,7 +37,7 @@ struct UniqueKeyClearer {
 			size_t column = (*key_columns)[n];
 			delete_sql += table->columns[column].name;
 			delete_sql += '=';
-			delete_sql += encode(*client, table->columns[column], row[column]);
+			encoders.append(*client, table->columns, column, row[column], delete_sql.curr);
 		}
 	}
 
@@ -46,6 +50,7 @@ struct UniqueKeyClearer {
 	DatabaseClient *client;
 	const Table *table;
 	const ColumnIndices *key_columns;
+	ColumnEncoders<DatabaseClient> encoders;
 	BaseSQL delete_sql;
 };
 
@@ -0,0 +1,64 @@
+require File.expand_path(File.join(File.dirname(__FILE__), 'test_helper'))
+
+class KeyCacheFromTest < KitchenSync::EndpointTestCase
+  include TestTableSchemas
+
+  def from_or_to
+    :from
+  end
+
+  def setup_with_footbl
+    clear_schema
+    create_footbl
+    execute "INSERT INTO footbl VALUES (2, 10, 'test'), (4, NULL, 'foo'), (5, NULL, NULL), (8, -1, 'longer str'), (100, 0, 'last')"
+    @rows = [[2,    10,       "test"],
+             [4,   nil,        "foo"],
+             [5,   nil,          nil],
+             [8,    -1, "longer str"],
+             [100,   0,       "last"]]
+    @keys = @rows.collect {|row| [row[0]]}
+    send_handshake_commands
+  end
+
+  test_each "accepts the requested key cache size up to its limit" do
+    setup_with_footbl
+    send_key_cache_size_command 8
+    send_key_cache_size_command 1000, 127
+  end
+
+  test_each "refers back to keys that have been sent in either direction since the table was opened" do
+    setup_with_footbl
+    send_key_cache_size_command 8
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT, [[], @keys[0], hash_of(@rows[0..0])] # @keys[0] is now in position 0
+
+    send_command   Commands::HASH_NEXT, [0, @keys[1], hash_of(@rows[1..1])] # @keys[1] is now in position 1
+    expect_command Commands::HASH_NEXT, [1, @keys[3], hash_of(@rows[2..3])] # @keys[3] is now in position 2
+
+    send_command   Commands::HASH_NEXT, [1, @keys[4], hash_of(@rows[2..4])] # @keys[4] is now in position 3
+    expect_command Commands::ROWS, [3, []]
+  end
+
+  test_each "wraps around when the key cache is full" do
+    setup_with_footbl
+    send_key_cache_size_command 1
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT, [[], @keys[0], hash_of(@rows[0..0])]
+
+    send_command   Commands::HASH_NEXT, [0, @keys[1], hash_of(@rows[1..1])]
+    expect_command Commands::HASH_NEXT, [0, @keys[3], hash_of(@rows[2..3])]
+  end
+
+  test_each "starts again with an empty key cache when the next table is opened" do
+    setup_with_footbl
+    send_key_cache_size_command 8
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT, [[], @keys[0], hash_of(@rows[0..0])]
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT, [[], @keys[0], hash_of(@rows[0..0])]
+  end
+end
@@ -0,0 +1,87 @@
+// checks that KeyComparator orders keys the same way as the databases, and that the normalized key encoding
+// agrees with it.  built by default and run by the test suite along with the ruby tests.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "../src/schema.h"
+#include "../src/message_pack/flat_row.h"
+#include "../src/key_comparator.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static int sign(int value) {
+	return (value < 0 ? -1 : value > 0 ? 1 : 0);
+}
+
+// each group of values is given in order, and the values within a group are equal
+static void check_ordering(const string &column_type, const vector<vector<string>> &groups) {
+	Table table("test");
+	table.columns.push_back(Column("key", false, DefaultType::no_default, "", column_type));
+	table.primary_key_columns.push_back(0);
+	KeyComparator comparator(table);
+
+	vector<FlatRow> rows;
+	vector<size_t> group_of;
+	vector<string> values;
+	for (size_t group = 0; group < groups.size(); group++) {
+		for (const string &value : groups[group]) {
+			rows.push_back(FlatRow());
+			rows.back() << value;
+			group_of.push_back(group);
+			values.push_back(value);
+		}
+	}
+
+	vector<string> normalized(rows.size());
+	for (size_t n = 0; n < rows.size(); n++) comparator.normalize_key(rows[n], normalized[n]);
+
+	for (size_t a = 0; a < rows.size(); a++) {
+		for (size_t b = 0; b < rows.size(); b++) {
+			int expected = (group_of[a] < group_of[b] ? -1 : group_of[a] > group_of[b] ? 1 : 0);
+			int compared = sign(comparator.compare(rows[a], rows[b]));
+			int normalized_compared = sign(normalized[a].compare(normalized[b]));
+			if (compared != expected || normalized_compared != expected) {
+				cerr << column_type << " " << values[a] << " vs " << values[b] << ": expected " << expected
+					 << ", compare gave " << compared << ", normalized keys gave " << normalized_compared << endl;
+				failures++;
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	check_ordering(ColumnTypes::DECI, {
+		{"-Infinity"},
+		{"-1000"},
+		{"-1.5", "-1.50"},
+		{"-1"},
+		{"-0.001"},
+		{"0", "-0", "0.000", "+0"},
+		{"0.001", "0.0010"},
+		{"1", "1.0", "01"},
+		{"1.5"},
+		{"20"},
+		{"123456789012345678901234567890.5"},
+		{"Infinity", "+Infinity"},
+		{"NaN"},
+	});
+
+	check_ordering(ColumnTypes::REAL, {
+		{"-Infinity", "-inf"},
+		{"-1.5"},
+		{"0", "-0"},
+		{"1e-10"},
+		{"1.5"},
+		{"Infinity", "inf"},
+		{"NaN"},
+	});
+
+	if (failures) {
+		cerr << failures << " comparisons failed" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,26 @@
+require File.expand_path(File.join(File.dirname(__FILE__), 'test_helper'))
+
+class PingFromTest < KitchenSync::EndpointTestCase
+  def from_or_to
+    :from
+  end
+
+  test_each "responds to pings with the requested number of bytes" do
+    clear_schema
+    send_protocol_command
+
+    send_command   Commands::PING, [0]
+    expect_command Commands::PING, [""]
+
+    send_command   Commands::PING, [1000]
+    expect_command Commands::PING, ["\0"*1000]
+  end
+
+  test_each "limits the size of the response" do
+    clear_schema
+    send_protocol_command
+
+    send_command   Commands::PING, [10*1024*1024]
+    expect_command Commands::PING, ["\0"*1024*1024]
+  end
+end
@@ -0,0 +1,113 @@
+// checks that the binary-format PostgreSQL values are converted to exactly the text that the server gives for
+// text-format results, since the hashes of the rows depend on it.  the expected values are the server's output.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include "../src/postgresql_binary_format.h"
+
+using namespace std;
+
+static int failures = 0;
+
+static void append_big_endian(string &data, uint64_t value, int bytes) {
+	for (int shift = 8*(bytes - 1); shift >= 0; shift -= 8) data += (char)(uint8_t)(value >> shift);
+}
+
+static void check(const string &type, void (*append)(string &, const uint8_t *, size_t), const string &data, const string &expected) {
+	string result;
+	append(result, (const uint8_t *)data.data(), data.size());
+	if (result != expected) {
+		cerr << type << ": expected " << expected << " but got " << result << endl;
+		failures++;
+	}
+}
+
+static string numeric(int weight, uint16_t sign, int dscale, const vector<uint16_t> &digits) {
+	string data;
+	append_big_endian(data, digits.size(), 2);
+	append_big_endian(data, (uint16_t)weight, 2);
+	append_big_endian(data, sign, 2);
+	append_big_endian(data, dscale, 2);
+	for (uint16_t digit : digits) append_big_endian(data, digit, 2);
+	return data;
+}
+
+static void check_numeric(int weight, uint16_t sign, int dscale, const vector<uint16_t> &digits, const string &expected) {
+	check("numeric", &append_binary_numeric, numeric(weight, sign, dscale, digits), expected);
+}
+
+static void check_date(int32_t days, const string &expected) {
+	string data;
+	append_big_endian(data, (uint32_t)days, 4);
+	check("date", &append_binary_date, data, expected);
+}
+
+static void check_time(int64_t microseconds, const string &expected) {
+	string data;
+	append_big_endian(data, (uint64_t)microseconds, 8);
+	check("time", &append_binary_time, data, expected);
+}
+
+static void check_timestamp(int64_t microseconds, const string &expected) {
+	string data;
+	append_big_endian(data, (uint64_t)microseconds, 8);
+	check("timestamp", &append_binary_timestamp, data, expected);
+}
+
+const uint16_t NUMERIC_POS = 0x0000, NUMERIC_NEG = 0x4000, NUMERIC_NAN = 0xc000, NUMERIC_PINF = 0xd000, NUMERIC_NINF = 0xf000;
+
+const int64_t SECOND = 1000000;
+const int64_t DAY = 86400*SECOND;
+
+int main(int argc, char *argv[]) {
+	check_numeric(0, NUMERIC_POS, 0, {}, "0");
+	check_numeric(0, NUMERIC_POS, 2, {}, "0.00");
+	check_numeric(0, NUMERIC_POS, 0, {12}, "12");
+	check_numeric(1, NUMERIC_POS, 0, {1}, "10000"); // trailing zero digits aren't sent
+	check_numeric(1, NUMERIC_NEG, 2, {12, 3456, 7800}, "-123456.78"); // the scale truncates the last digit
+	check_numeric(0, NUMERIC_POS, 4, {12}, "12.0000"); // and pads if there aren't enough digits
+	check_numeric(0, NUMERIC_POS, 1, {1, 5000}, "1.5");
+	check_numeric(-1, NUMERIC_POS, 3, {10}, "0.001");
+	check_numeric(-2, NUMERIC_NEG, 8, {1}, "-0.00000001");
+	check_numeric(-2, NUMERIC_POS, 10, {1234, 5600}, "0.0000123456");
+	check_numeric(0, NUMERIC_NAN, 0, {}, "NaN");
+	check_numeric(0, NUMERIC_PINF, 0, {}, "Infinity");
+	check_numeric(0, NUMERIC_NINF, 0, {}, "-Infinity");
+
+	check_date(0, "2000-01-01");
+	check_date(-10957, "1970-01-01");
+	check_date(-1, "1999-12-31");
+	check_date(59, "2000-02-29");
+	check_date(-730119, "0001-01-01");
+	check_date(-730120, "0001-12-31 BC");
+	check_date(-730426, "0001-02-29 BC"); // 1 BC is a leap year in the proleptic gregorian calendar
+	check_date(-2451545, "4714-11-24 BC"); // the earliest date postgresql supports
+	check_date(2921939, "9999-12-31");
+	check_date(2921940, "10000-01-01");
+	check_date(INT32_MAX, "infinity");
+	check_date(INT32_MIN, "-infinity");
+
+	check_time(0, "00:00:00");
+	check_time(12*3600*SECOND + 34*60*SECOND + 56*SECOND, "12:34:56");
+	check_time(12*3600*SECOND + 34*60*SECOND + 56*SECOND + 120000, "12:34:56.12");
+	check_time(1, "00:00:00.000001");
+	check_time(500000, "00:00:00.5");
+	check_time(DAY - 1, "23:59:59.999999");
+	check_time(DAY, "24:00:00");
+
+	check_timestamp(0, "2000-01-01 00:00:00");
+	check_timestamp(-1, "1999-12-31 23:59:59.999999");
+	check_timestamp(DAY + 3600*SECOND + 250000, "2000-01-02 01:00:00.25");
+	check_timestamp(-730120*DAY + 86399*SECOND + 500000, "0001-12-31 23:59:59.5 BC");
+	check_timestamp(-2451545*DAY, "4714-11-24 00:00:00 BC");
+	check_timestamp(2921940*DAY + 60*SECOND, "10000-01-01 00:01:00");
+	check_timestamp(INT64_MAX, "infinity");
+	check_timestamp(INT64_MIN, "-infinity");
+
+	if (failures) {
+		cerr << failures << " values were formatted incorrectly" << endl;
+		return 1;
+	}
+	return 0;
+}
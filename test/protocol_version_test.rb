@@ -2,7 +2,7 @@ require File.expand_path(File.join(File.dirname(__FILE__), 'test_helper'))
 
 class ProtocolVersionTest < KitchenSync::EndpointTestCase
   EARLIEST_PROTOCOL_VERSION_SUPPORTED = 5
-  LATEST_PROTOCOL_VERSION_SUPPORTED = 6
+  LATEST_PROTOCOL_VERSION_SUPPORTED = 10
 
   def from_or_to
     :from
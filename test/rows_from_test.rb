@@ -173,4 +173,57 @@ class RowsFromTest < KitchenSync::EndpointTestCase
     expect_command Commands::ROWS,
                    [[], []]
   end
+
+  test_each "sends repeated strings as references to their first occurrence in the same response if dictionary encoding is used" do
+    create_some_tables
+    execute "INSERT INTO footbl VALUES (2, 10, 'test'), (4, NULL, 'test'), (5, NULL, 'foo'), (6, NULL, 'foo'), (8, -1, 'test')"
+    send_handshake_commands
+    send_rows_encoding_command RowsEncoding::DICTIONARY
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT,
+                   [[], [2], hash_of([[2, 10, "test"]])]
+
+    send_command   Commands::ROWS, [[1], [8]] # strings shorter than 4 bytes aren't worth referencing
+    expect_command Commands::ROWS,
+                   [[1], [8]],
+                   [2,  10, "test"],
+                   [4, nil,    [0]],
+                   [5, nil,  "foo"],
+                   [6, nil,  "foo"],
+                   [8,  -1,    [0]]
+
+    send_command   Commands::ROWS, [[3], [4]] # each response starts a new dictionary
+    expect_command Commands::ROWS,
+                   [[3], [4]],
+                   [4, nil, "test"]
+  end
+
+  test_each "sends rows in batches a column at a time if columnar encoding is used" do
+    create_some_tables
+    execute "INSERT INTO footbl VALUES (2, 10, 'test'), (4, NULL, 'foo'), (5, NULL, NULL), (8, -1, 'longer str')"
+    send_handshake_commands
+    send_rows_encoding_command RowsEncoding::COLUMNAR
+
+    send_command   Commands::OPEN, ["footbl"]
+    expect_command Commands::HASH_NEXT,
+                   [[], [2], hash_of([[2, 10, "test"]])]
+
+    # each column is an encoding byte, a bitmap of NULLs, and the other values; integers are sent as
+    # zigzag differences from the previous value, and strings as the length of the prefix they share
+    # with the previous value followed by the length and bytes of the rest
+    send_command   Commands::ROWS, [[1], [8]]
+    expect_command Commands::ROWS,
+                   [[1], [8]],
+                   [4,
+                    [1, 0b0000, 4, 4, 2, 6].pack("C*"),
+                    [1, 0b0110, 20, 21].pack("C*"),
+                    [2, 0b0100, 0, 4].pack("C*") + "test" + [0, 3].pack("C*") + "foo" + [0, 10].pack("C*") + "longer str"]
+  end
+
+  test_each "falls back to plain rows if asked for an unknown encoding" do
+    create_some_tables
+    send_handshake_commands
+    send_rows_encoding_command 99, RowsEncoding::PLAIN
+  end
 end
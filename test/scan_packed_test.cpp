@@ -0,0 +1,272 @@
+// checks scan_packed_values, which finds value boundaries in buffered msgpack in one pass (using SSE2 for runs of
+// single-byte values where available), against a straightforward byte-at-a-time scan, and checks that unpacking
+// rows gives the same results whether or not they were all buffered.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include "../src/message_pack/flat_row.h"
+
+using namespace std;
+
+static int failures = 0;
+static mt19937 rng(42);
+
+static size_t random_below(size_t limit) {
+	return uniform_int_distribution<size_t>(0, limit - 1)(rng);
+}
+
+static void append_big_endian(vector<uint8_t> &data, uint64_t value, int bytes) {
+	for (int shift = 8*(bytes - 1); shift >= 0; shift -= 8) data.push_back((uint8_t)(value >> shift));
+}
+
+// packs a random value, using every encoding that the scanner handles, and returns the number of values packed.
+// at the top level this may be a run of single-byte values, which are common so that the SSE2 path sees long runs
+// both inside and outside of arrays and maps.
+static size_t append_random_value(vector<uint8_t> &data, int depth, bool allow_runs = true) {
+	static const uint8_t single_bytes[] = { 0x00, 0x01, 0x7f, 0xe0, 0xff, MSGPACK_NIL, MSGPACK_FALSE, MSGPACK_TRUE };
+
+	switch (random_below(depth < 3 ? 12 : 9)) {
+		case 0: case 1: case 2: {
+			size_t values = (allow_runs ? random_below(24) + 1 : 1);
+			for (size_t n = 0; n < values; n++) data.push_back(single_bytes[random_below(sizeof(single_bytes))]);
+			return values;
+		}
+
+		case 3: {
+			size_t length = random_below(32);
+			data.push_back(MSGPACK_FIXRAW_MIN + length);
+			for (size_t n = 0; n < length; n++) data.push_back((uint8_t)random_below(256));
+			return 1;
+		}
+
+		case 4: {
+			size_t length = random_below(300);
+			bool raw32 = random_below(2);
+			data.push_back(raw32 ? MSGPACK_RAW32 : MSGPACK_RAW16);
+			append_big_endian(data, length, raw32 ? 4 : 2);
+			for (size_t n = 0; n < length; n++) data.push_back((uint8_t)random_below(256));
+			return 1;
+		}
+
+		case 5: {
+			static const uint8_t leaders[] = { MSGPACK_UINT8, MSGPACK_INT8, MSGPACK_UINT16, MSGPACK_INT16, MSGPACK_UINT32, MSGPACK_INT32, MSGPACK_FLOAT, MSGPACK_UINT64, MSGPACK_INT64, MSGPACK_DOUBLE };
+			static const int payloads[] = { 1, 1, 2, 2, 4, 4, 4, 8, 8, 8 };
+			size_t type = random_below(sizeof(leaders));
+			data.push_back(leaders[type]);
+			for (int n = 0; n < payloads[type]; n++) data.push_back((uint8_t)random_below(256));
+			return 1;
+		}
+
+		case 6: case 7: case 8:
+			data.push_back(single_bytes[random_below(sizeof(single_bytes))]);
+			return 1;
+
+		default: {
+			bool map = (random_below(3) == 0);
+			size_t size = random_below(map ? 8 : 20);
+			switch (random_below(3)) {
+				case 0:
+					if (size < 16) {
+						data.push_back((map ? MSGPACK_FIXMAP_MIN : MSGPACK_FIXARRAY_MIN) + size);
+						break;
+					}
+					// fall through
+				case 1:
+					data.push_back(map ? MSGPACK_MAP16 : MSGPACK_ARRAY16);
+					append_big_endian(data, size, 2);
+					break;
+				default:
+					data.push_back(map ? MSGPACK_MAP32 : MSGPACK_ARRAY32);
+					append_big_endian(data, size, 4);
+			}
+			for (size_t n = (map ? 2*size : size); n; n--) append_random_value(data, depth + 1, false);
+			return 1;
+		}
+	}
+}
+
+// the straightforward version: reads each value's leader in turn, recursing for arrays and maps
+static bool reference_scan_value(const vector<uint8_t> &data, size_t available, size_t &pos) {
+	if (pos >= available) return false;
+	uint8_t leader = data[pos++];
+	size_t payload = 0, children = 0;
+
+	if (leader <= MSGPACK_POSITIVE_FIXNUM_MAX || leader >= MSGPACK_NEGATIVE_FIXNUM_MIN || leader == MSGPACK_NIL || leader == MSGPACK_FALSE || leader == MSGPACK_TRUE) {
+	} else if (leader >= MSGPACK_FIXRAW_MIN && leader <= MSGPACK_FIXRAW_MAX) {
+		payload = leader & 31;
+	} else if (leader >= MSGPACK_FIXARRAY_MIN && leader <= MSGPACK_FIXARRAY_MAX) {
+		children = leader & 15;
+	} else if (leader >= MSGPACK_FIXMAP_MIN && leader <= MSGPACK_FIXMAP_MAX) {
+		children = 2*(leader & 15);
+	} else if (leader == MSGPACK_UINT8 || leader == MSGPACK_INT8) {
+		payload = 1;
+	} else if (leader == MSGPACK_UINT16 || leader == MSGPACK_INT16) {
+		payload = 2;
+	} else if (leader == MSGPACK_UINT32 || leader == MSGPACK_INT32 || leader == MSGPACK_FLOAT) {
+		payload = 4;
+	} else if (leader == MSGPACK_UINT64 || leader == MSGPACK_INT64 || leader == MSGPACK_DOUBLE) {
+		payload = 8;
+	} else {
+		int size_bytes = (leader == MSGPACK_RAW16 || leader == MSGPACK_ARRAY16 || leader == MSGPACK_MAP16 ? 2 : 4);
+		if (available - pos < (size_t)size_bytes) return false;
+		size_t size = 0;
+		for (int n = 0; n < size_bytes; n++) size = (size << 8) | data[pos++];
+		if (leader == MSGPACK_RAW16 || leader == MSGPACK_RAW32) payload = size;
+		else if (leader == MSGPACK_MAP16 || leader == MSGPACK_MAP32) children = 2*size;
+		else children = size;
+	}
+
+	if (payload > available - pos) return false;
+	pos += payload;
+	while (children--) {
+		if (!reference_scan_value(data, available, pos)) return false;
+	}
+	return true;
+}
+
+static bool reference_scan_values(const vector<uint8_t> &data, size_t available, size_t count, size_t &length, vector<uint32_t> &starts) {
+	size_t pos = 0;
+	for (size_t n = 0; n < count; n++) {
+		starts[n] = pos;
+		if (!reference_scan_value(data, available, pos)) return false;
+	}
+	length = pos;
+	return true;
+}
+
+// scans the first count values in the first available bytes, copied to a buffer of exactly that size so that
+// reading past the end is caught by ASan
+static void check_scan(const string &description, const vector<uint8_t> &data, size_t available, size_t count) {
+	vector<uint8_t> buffer(data.begin(), data.begin() + available);
+	vector<uint32_t> starts(count + 1), expected_starts(count + 1);
+	size_t length = 0, expected_length = 0;
+	bool scanned = scan_packed_values(buffer.data(), available, count, length, starts.data());
+	bool expected = reference_scan_values(data, available, count, expected_length, expected_starts);
+	if (scanned != expected || (expected && (length != expected_length || starts != expected_starts))) {
+		cerr << description << ": scanning " << count << " values in " << available << " of " << data.size() << " bytes gave "
+			 << (scanned ? "length " + to_string(length) : string("false")) << ", expected "
+			 << (expected ? "length " + to_string(expected_length) : string("false")) << endl;
+		failures++;
+	}
+}
+
+static void check_scan(const string &description, const vector<uint8_t> &data, size_t count) {
+	check_scan(description, data, data.size(), count);
+}
+
+// a stream that only has part of the data buffered at a time, ending at random points
+struct ChunkedStream {
+	ChunkedStream(const vector<uint8_t> &data): data(data), pos(0), buffered_to(0) {}
+
+	inline void read(uint8_t *dest, size_t bytes) {
+		if (pos + bytes > data.size()) throw runtime_error("read past end of data");
+		memcpy(dest, data.data() + pos, bytes);
+		pos += bytes;
+		if (buffered_to < pos) buffered_to = pos;
+	}
+
+	inline const uint8_t *peek(size_t &bytes_available) {
+		if (buffered_to == pos) buffered_to = min(data.size(), pos + random_below(64));
+		bytes_available = buffered_to - pos;
+		return data.data() + pos;
+	}
+
+	inline void skip(size_t bytes) {
+		pos += bytes;
+		if (buffered_to < pos) buffered_to = pos;
+	}
+
+	const vector<uint8_t> &data;
+	size_t pos;
+	size_t buffered_to;
+};
+
+static void check_rows_unpack_in_chunks() {
+	for (int iteration = 0; iteration < 2000; iteration++) {
+		// a stream of rows, each an array of values
+		vector<uint8_t> data;
+		vector<size_t> row_starts, row_columns;
+		for (size_t rows = random_below(10) + 1; rows; rows--) {
+			vector<uint8_t> values;
+			size_t columns = 0;
+			do {
+				columns += append_random_value(values, 1);
+			} while (columns < 20 && random_below(4));
+			row_starts.push_back(data.size());
+			row_columns.push_back(columns);
+			data.push_back(MSGPACK_ARRAY16);
+			append_big_endian(data, columns, 2);
+			data.insert(data.end(), values.begin(), values.end());
+		}
+
+		ChunkedStream stream(data);
+		Unpacker<ChunkedStream> unpacker(stream);
+		for (size_t row_number = 0; row_number < row_starts.size(); row_number++) {
+			FlatRow row;
+			unpacker >> row;
+
+			vector<uint32_t> expected_starts(row_columns[row_number] + 1);
+			size_t expected_length;
+			vector<uint8_t> values(data.begin() + row_starts[row_number] + 3, row_number + 1 < row_starts.size() ? data.begin() + row_starts[row_number + 1] : data.end());
+			reference_scan_values(values, values.size(), row_columns[row_number], expected_length, expected_starts);
+			expected_starts.pop_back();
+
+			if (row.column_offsets != expected_starts || row.encoded.size() != values.size() || memcmp(row.encoded.data(), values.data(), values.size())) {
+				cerr << "row " << row_number << " of iteration " << iteration << " was unpacked incorrectly" << endl;
+				failures++;
+				return;
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	// runs of single-byte values longer than the values remaining in an array, or at the top level
+	vector<uint8_t> data = { 0x92, 0x01, 0x02 };
+	data.insert(data.end(), 20, MSGPACK_NIL);
+	check_scan("run after array", data, 1);
+	check_scan("run after array", data, 3);
+	check_scan("run after array", data, 21);
+	check_scan("run after array", data, 23);
+
+	data.assign(40, 0x05);
+	for (size_t count = 0; count <= 40; count++) check_scan("run at top level", data, count);
+	check_scan("run at top level", data, 41);
+
+	data = { 0xdc, 0x00, 0x03, 0x01, 0x02, 0x92, 0x03, 0xc3 };
+	data.insert(data.end(), 30, 0xff);
+	for (size_t count = 1; count <= 31; count++) check_scan("run after nested arrays", data, count);
+
+	// values that cross the end of the span
+	data = { 0x01, 0xa5, 'a', 'b', 'c', 'd', 'e', 0x02 };
+	for (size_t available = 0; available <= data.size(); available++) check_scan("fixraw crossing end", data, available, 3);
+	data = { 0x93, 0x01, 0x02 };
+	data.insert(data.end(), 20, 0x03);
+	check_scan("array crossing end", data, 3, 1);
+
+	// headers that are cut off
+	data = { MSGPACK_RAW16, 0x00, 0x02, 'a', 'b' };
+	for (size_t available = 0; available <= data.size(); available++) check_scan("raw16 header", data, available, 1);
+	data = { MSGPACK_RAW32, 0x00, 0x00, 0x00, 0x02, 'a', 'b' };
+	for (size_t available = 0; available <= data.size(); available++) check_scan("raw32 header", data, available, 1);
+	data = { MSGPACK_ARRAY32, 0x00, 0x00, 0x00, 0x02, 0x01, 0x02 };
+	for (size_t available = 0; available <= data.size(); available++) check_scan("array32 header", data, available, 1);
+
+	// random values, cut off at random points
+	for (int iteration = 0; iteration < 20000; iteration++) {
+		data.clear();
+		for (size_t values = random_below(8) + 1; values; values--) append_random_value(data, 0);
+		size_t available = (random_below(4) == 0 ? data.size() : random_below(data.size() + 1));
+		check_scan("random values", data, available, random_below(40) + 1);
+	}
+
+	check_rows_unpack_in_chunks();
+
+	if (failures) {
+		cerr << failures << " checks failed" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -67,4 +67,31 @@ class SchemaFromTest < KitchenSync::EndpointTestCase
     expect_command Commands::SCHEMA,
                    [{"tables" => [autotbl_def]}]
   end
+
+  test_each "lists the partitions of partitioned tables" do
+    clear_schema
+    create_parttbl
+    send_handshake_commands
+
+    send_command   Commands::SCHEMA
+    expect_command Commands::SCHEMA,
+                   [{"tables" => [parttbl_def]}]
+  end
+
+  test_each "lists partitions as tables of their own to ends using older protocol versions" do
+    clear_schema
+    create_parttbl
+    send_command   Commands::PROTOCOL, [9]
+    expect_command Commands::PROTOCOL, [9]
+    send_without_snapshot_command
+
+    # older versions don't know about partitions, and on PostgreSQL they see each partition as a table
+    table_def = parttbl_def.reject {|key, value| key == "partitions"}
+    table_defs = [table_def]
+    table_defs += %w(parttbl_high parttbl_low).collect {|name| table_def.merge("name" => name)} if @database_server == 'postgresql'
+
+    send_command   Commands::SCHEMA
+    expect_command Commands::SCHEMA,
+                   [{"tables" => table_defs}]
+  end
 end
@@ -836,4 +836,30 @@ SQL
     assert_equal nil, connection.table_column_defaults("secondtbl")["tri"]
     assert_same_keys(secondtbl_def)
   end
+
+  test_each "opens each partition of a partitioned table separately if the partitions match" do
+    clear_schema
+    create_parttbl
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [parttbl_def]]
+    parttbl_def["partitions"].each do |partition|
+      expect_command Commands::OPEN, [partition["name"]]
+      send_command   Commands::ROWS, [[], []]
+    end
+    expect_quit_and_close
+  end
+
+  test_each "opens the whole table if the partitions don't match" do
+    clear_schema
+    create_parttbl
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [parttbl_def.merge("partitions" => parttbl_def["partitions"].first(1))]]
+    expect_command Commands::OPEN, ["parttbl"]
+    send_command   Commands::ROWS, [[], []]
+    expect_quit_and_close
+  end
 end
@@ -0,0 +1,69 @@
+require File.expand_path(File.join(File.dirname(__FILE__), 'test_helper'))
+require 'timeout'
+
+# these tests run the ks program itself rather than talking to a single endpoint, since the endpoints only use
+# shared memory rings when ks starts both of them on the same host.
+class SharedMemoryRingTest < KitchenSync::EndpointTestCase
+  include TestTableSchemas
+
+  RUN_TIMEOUT = 60 # seconds; long enough for a tiny sync, short enough to notice a hung end
+
+  def from_or_to
+    :to
+  end
+
+  def database_url(name = database_name)
+    "#{@database_server}://#{database_username}:#{database_password}@#{database_host}#{":#{database_port}" unless database_port.empty?}/#{name}"
+  end
+
+  def run_ks(*args)
+    Timeout.timeout(RUN_TIMEOUT) do
+      IO.popen([File.join(File.dirname(__FILE__), '..', 'build', 'ks'), *args], :err => [:child, :out]) do |io|
+        @output = io.read
+      end
+      $?
+    end
+  end
+
+  test_each "synchronizes through shared memory rings and finishes cleanly when the ends close them" do
+    clear_schema
+    create_footbl
+    execute "INSERT INTO footbl VALUES (2, 10, 'test'), (4, NULL, 'foo'), (5, NULL, NULL)"
+
+    status = run_ks("--from", database_url, "--to", database_url, "--workers", "2", "--debug")
+    assert status.success?, @output
+    assert_match /using shared memory rings/, @output
+    assert_match /Finished Kitchen Syncing/, @output
+
+    assert_equal [[2, 10, "test"], [4, nil, "foo"], [5, nil, nil]],
+                 query("SELECT * FROM footbl ORDER BY col1")
+  end
+
+  test_each "fails rather than hanging if the 'from' end exits early" do
+    clear_schema
+    create_footbl
+
+    status = run_ks("--from", database_url("ks_nonexistant_database"), "--to", database_url)
+    assert !status.success?, @output
+    assert_match /Kitchen Syncing failed/, @output
+  end
+
+  test_each "fails rather than hanging if the 'to' end exits early" do
+    clear_schema
+    create_footbl
+
+    status = run_ks("--from", database_url, "--to", database_url("ks_nonexistant_database"))
+    assert !status.success?, @output
+    assert_match /Kitchen Syncing failed/, @output
+  end
+
+  test_each "uses pipes instead if asked to" do
+    clear_schema
+    create_footbl
+
+    status = run_ks("--from", database_url, "--to", database_url, "--without-shared-memory", "--debug")
+    assert status.success?, @output
+    assert_no_match /using shared memory rings/, @output
+    assert_match /Finished Kitchen Syncing/, @output
+  end
+end
@@ -51,6 +51,39 @@ class SyncToTest < KitchenSync::EndpointTestCase
                  query("SELECT * FROM footbl ORDER BY col1")
   end
 
+  test_each "looks up dictionary references in the rows it is sent if dictionary encoding is used" do
+    clear_schema
+    create_footbl
+
+    expect_handshake_commands(1, HashAlgorithm::MD5, RowsEncoding::DICTIONARY)
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [footbl_def]]
+    expect_command Commands::OPEN, ["footbl"]
+    send_command   Commands::ROWS, [[], []], [2, 10, "test"], [4, nil, "foo"], [5, nil, [0]], [8, -1, "longer str"], [9, 0, [1]]
+    expect_quit_and_close
+
+    assert_equal [[2, 10, "test"], [4, nil, "foo"], [5, nil, "test"], [8, -1, "longer str"], [9, 0, "longer str"]],
+                 query("SELECT * FROM footbl ORDER BY col1")
+  end
+
+  test_each "decodes batches of rows if columnar encoding is used" do
+    clear_schema
+    create_footbl
+
+    expect_handshake_commands(1, HashAlgorithm::MD5, RowsEncoding::COLUMNAR)
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [footbl_def]]
+    expect_command Commands::OPEN, ["footbl"]
+    send_command   Commands::ROWS, [[], []], [2,
+                                              [1, 0b00, 4, 4].pack("C*"),
+                                              [1, 0b10, 20].pack("C*"),
+                                              [2, 0b00, 0, 4].pack("C*") + "test" + [4, 3].pack("C*") + "ing"]
+    expect_quit_and_close
+
+    assert_equal [[2, 10, "test"], [4, nil, "testing"]],
+                 query("SELECT * FROM footbl ORDER BY col1")
+  end
+
   test_each "accepts matching hashes and asked for the hash of the next row(s), doubling the number of rows" do
     setup_with_footbl
 
@@ -278,6 +311,57 @@ class SyncToTest < KitchenSync::EndpointTestCase
                  query("SELECT * FROM footbl ORDER BY col1")
   end
 
+  test_each "handles appending rows that take unique values from replaced rows" do
+    setup_with_footbl
+    execute "CREATE UNIQUE INDEX unique_key ON footbl (col3)"
+
+    @rows[-1][-1] = "new value"  # change the value on the last row
+    @rows << [1002, 0, "last"]   # and give its old value to a new row after it
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [footbl_def.merge("keys" => [{"name" => "unique_key", "unique" => true, "columns" => [2]}])]]
+    expect_command Commands::OPEN, ["footbl"]
+    send_results   Commands::ROWS,
+                   [[], []],
+                   *@rows
+    expect_quit_and_close
+
+    assert_equal @rows,
+                 query("SELECT * FROM footbl ORDER BY col1")
+  end
+
+  test_each "restores the settings relaxed for fast apply before committing" do
+    setup_with_footbl
+    program_env["ENDPOINT_FAST_APPLY"] = "1"
+
+    if @database_server == "postgresql"
+      # ordinary triggers shouldn't fire while we're applying changes, but ALWAYS triggers do; this one is deferred
+      # until the commit, so it sees the session settings after we've finished applying changes
+      execute "CREATE OR REPLACE FUNCTION fail_trigger() RETURNS trigger AS $$ BEGIN RAISE EXCEPTION 'trigger fired during fast apply'; END $$ LANGUAGE plpgsql"
+      execute "CREATE OR REPLACE FUNCTION check_replication_role() RETURNS trigger AS $$ BEGIN IF current_setting('session_replication_role') <> 'origin' THEN RAISE EXCEPTION 'session_replication_role not restored'; END IF; RETURN NULL; END $$ LANGUAGE plpgsql"
+      execute "CREATE TRIGGER footbl_fail AFTER INSERT OR UPDATE OR DELETE ON footbl FOR EACH ROW EXECUTE PROCEDURE fail_trigger()"
+      execute "CREATE CONSTRAINT TRIGGER footbl_check AFTER INSERT OR UPDATE OR DELETE ON footbl DEFERRABLE INITIALLY DEFERRED FOR EACH ROW EXECUTE PROCEDURE check_replication_role()"
+      execute "ALTER TABLE footbl ENABLE ALWAYS TRIGGER footbl_check"
+    end
+
+    @rows[0][-1] = "changed"
+    @rows << [1002, 0, "appended"]
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [footbl_def]]
+    expect_command Commands::OPEN, ["footbl"]
+    send_results   Commands::ROWS,
+                   [[], []],
+                   *@rows
+    expect_quit_and_close
+
+    # the commit fails, and so the changes are lost, if the deferred trigger raises
+    assert_equal @rows,
+                 query("SELECT * FROM footbl ORDER BY col1")
+  end
+
   test_each "accepts large insert sets" do
     clear_schema
     create_texttbl
@@ -297,4 +381,90 @@ class SyncToTest < KitchenSync::EndpointTestCase
     assert_equal @rows,
                  query("SELECT * FROM texttbl ORDER BY pri")
   end
+
+  test_each "clears unique values from later rows when inserting rows in the middle of the table" do
+    clear_schema
+    execute(<<-SQL)
+      CREATE TABLE uniquetbl (
+        pri INT NOT NULL,
+        uniq INT NOT NULL,
+        textfield TEXT#{'(268435456)' if @database_server == 'mysql'},
+        PRIMARY KEY(pri))
+SQL
+    execute "CREATE UNIQUE INDEX uniqidx ON uniquetbl (uniq)"
+    execute "INSERT INTO uniquetbl VALUES (1, 1, 'first'), (100, 2, 'later')"
+    uniquetbl_def =
+      { "name"    => "uniquetbl",
+        "columns" => [
+          {"name" => "pri",       "column_type" => ColumnTypes::SINT, "size" => 4, "nullable" => false},
+          {"name" => "uniq",      "column_type" => ColumnTypes::SINT, "size" => 4, "nullable" => false},
+          {"name" => "textfield", "column_type" => ColumnTypes::TEXT}],
+        "primary_key_columns" => [0],
+        "keys" => [{"name" => "uniqidx", "unique" => true, "columns" => [1]}] }
+
+    # the first new row takes the unique value held by the later row, which is only changed after enough new rows
+    # have been inserted that the statements built up so far get applied
+    @rows = [[1, 1, "first"]] +
+            (2..11).collect {|n| [n, n == 2 ? 2 : n + 100, (97 + n % 26).chr*512*1024]} +
+            [[100, 3, "later"]]
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [uniquetbl_def]]
+    expect_command Commands::OPEN, ["uniquetbl"]
+    send_results   Commands::ROWS,
+                   [[], []],
+                   *@rows
+    expect_quit_and_close
+
+    assert_equal @rows,
+                 query("SELECT * FROM uniquetbl ORDER BY pri")
+  end
+
+  test_each "applies rows to tables whose primary keys aren't all integers" do
+    clear_schema
+    create_secondtbl
+    execute "INSERT INTO secondtbl VALUES (2, 2, 'aa', 10), (4, 100, 'aa', 20), (8, 101, 'bb', 30)"
+    @rows = [[2,   2, "aa", 11],
+             [9,   3, "aa", 40],
+             [8, 101, "bb", 30]]
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [secondtbl_def]]
+    expect_command Commands::OPEN, ["secondtbl"]
+    send_results   Commands::ROWS,
+                   [[], []],
+                   *@rows
+    expect_quit_and_close
+
+    assert_equal @rows,
+                 query("SELECT * FROM secondtbl ORDER BY pri2, pri1")
+  end
+
+  test_each "syncs the rows of each partition of a partitioned table" do
+    clear_schema
+    create_parttbl
+    execute "INSERT INTO parttbl VALUES (1, 10), (2, 20), (99, 990), (100, 1000), (200, 2000)"
+
+    @rows = [[1, 11], [3, 30], [99, 990], [100, 1000], [300, 3000]]
+    rows_by_partition = {}
+    parttbl_def["partitions"].each do |partition|
+      rows_by_partition[partition["name"]] = @rows.select {|row| (row[0] < 100) == (partition["name"] =~ /low/ ? true : false)}
+    end
+
+    expect_handshake_commands
+    expect_command Commands::SCHEMA
+    send_command   Commands::SCHEMA, ["tables" => [parttbl_def]]
+    parttbl_def["partitions"].each do |partition|
+      expect_command Commands::OPEN, [partition["name"]]
+      send_results   Commands::ROWS,
+                     [[], []],
+                     *rows_by_partition[partition["name"]]
+    end
+    expect_quit_and_close
+
+    assert_equal @rows,
+                 query("SELECT * FROM parttbl ORDER BY pri")
+  end
 end
@@ -275,6 +275,9 @@ module Commands
   SCHEMA = 37
   TARGET_BLOCK_SIZE = 38
   HASH_ALGORITHM = 39
+  KEY_CACHE_SIZE = 40
+  PING = 41
+  ROWS_ENCODING = 42
   QUIT = 0
 end
 
@@ -283,11 +286,17 @@ module HashAlgorithm
   XXH64 = 1
 end
 
+module RowsEncoding
+  PLAIN = 0
+  DICTIONARY = 1
+  COLUMNAR = 2
+end
+
 Verbs = Commands.constants.each_with_object({}) {|k, results| results[Commands.const_get(k)] = k.to_s.downcase}.freeze
 
 module KitchenSync
   class TestCase < Test::Unit::TestCase
-    PROTOCOL_VERSION_SUPPORTED = 6
+    PROTOCOL_VERSION_SUPPORTED = 10
 
     undef_method :default_test if instance_methods.include? 'default_test' or
                                   instance_methods.include? :default_test
@@ -354,18 +363,43 @@ module KitchenSync
       expect_command Commands::HASH_ALGORITHM, [hash_algorithm]
     end
 
-    def expect_handshake_commands(target_minimum_block_size = 1, hash_algorithm = HashAlgorithm::MD5)
+    def send_key_cache_size_command(key_cache_size, expected_key_cache_size = key_cache_size)
+      send_command   Commands::KEY_CACHE_SIZE, [key_cache_size]
+      expect_command Commands::KEY_CACHE_SIZE, [expected_key_cache_size]
+    end
+
+    def send_rows_encoding_command(rows_encoding, expected_rows_encoding = rows_encoding)
+      send_command   Commands::ROWS_ENCODING, [rows_encoding]
+      expect_command Commands::ROWS_ENCODING, [expected_rows_encoding]
+    end
+
+    def expect_handshake_commands(target_minimum_block_size = 1, hash_algorithm = HashAlgorithm::MD5, rows_encoding = RowsEncoding::PLAIN)
       # checking how protocol versions are handled is covered in protocol_versions_test; here we just need to get past that to get on to the commands we want to test
       expect_command Commands::PROTOCOL, [PROTOCOL_VERSION_SUPPORTED]
       send_command   Commands::PROTOCOL, [PROTOCOL_VERSION_SUPPORTED]
 
+      # answer the link probes, which aren't interesting here
+      command = read_command
+      while command.first == Commands::PING
+        send_command Commands::PING, ["\0"*command.last.first]
+        command = read_command
+      end
+
       # we force the block size down to 1 by default so we can test out our algorithms row-by-row, but real runs would use a bigger size
-      assert_equal   Commands::TARGET_BLOCK_SIZE, read_command.first
+      assert_equal   Commands::TARGET_BLOCK_SIZE, command.first
       send_command   Commands::TARGET_BLOCK_SIZE, [target_minimum_block_size]
 
       assert_equal   Commands::HASH_ALGORITHM, read_command.first
       send_command   Commands::HASH_ALGORITHM, [hash_algorithm]
 
+      # we turn off key references by default so that the tests can give the keys explicitly
+      assert_equal   Commands::KEY_CACHE_SIZE, read_command.first
+      send_command   Commands::KEY_CACHE_SIZE, [0]
+
+      # and send rows without the dictionary by default, so that the tests can give the values explicitly
+      assert_equal   Commands::ROWS_ENCODING, read_command.first
+      send_command   Commands::ROWS_ENCODING, [rows_encoding]
+
       # since we haven't asked for multiple workers, we'll always get sent the snapshot-less start command
       expect_command Commands::WITHOUT_SNAPSHOT
       send_command   Commands::WITHOUT_SNAPSHOT
@@ -437,7 +471,7 @@ module KitchenSync
     end
 
     def clear_schema
-      connection.tables.each {|table_name| execute "DROP TABLE #{table_name}"}
+      connection.tables.each {|table_name| execute "DROP TABLE IF EXISTS #{table_name}"} # partitions are dropped with their table
     end
 
     def hash_of(rows, hash_algorithm = HashAlgorithm::MD5)
@@ -237,4 +237,52 @@ SQL
       "primary_key_columns" => [0],
       "keys" => [] }
   end
+
+  def create_parttbl
+    case @database_server
+    when 'mysql'
+      execute(<<-SQL)
+        CREATE TABLE parttbl (
+          pri INT NOT NULL,
+          val INT,
+          PRIMARY KEY(pri))
+        PARTITION BY RANGE (pri) (
+          PARTITION p_low VALUES LESS THAN (100),
+          PARTITION p_high VALUES LESS THAN MAXVALUE)
+SQL
+    when 'postgresql'
+      execute(<<-SQL)
+        CREATE TABLE parttbl (
+          pri INT NOT NULL,
+          val INT,
+          PRIMARY KEY(pri))
+        PARTITION BY RANGE (pri)
+SQL
+      execute "CREATE TABLE parttbl_low PARTITION OF parttbl FOR VALUES FROM (MINVALUE) TO (100)"
+      execute "CREATE TABLE parttbl_high PARTITION OF parttbl FOR VALUES FROM (100) TO (MAXVALUE)"
+    end
+  end
+
+  def parttbl_def
+    { "name"    => "parttbl",
+      "columns" => [
+        {"name" => "pri", "column_type" => ColumnTypes::SINT, "size" => 4, "nullable" => false},
+        {"name" => "val", "column_type" => ColumnTypes::SINT, "size" => 4}],
+      "primary_key_columns" => [0],
+      "keys" => [],
+      "partitions" => parttbl_partitions }
+  end
+
+  def parttbl_partitions
+    case @database_server
+    when 'mysql'
+      # the server formats the partitioning expression itself, and quoting differs between versions
+      expression = query("SELECT partition_expression FROM information_schema.partitions WHERE table_schema = schema() AND table_name = 'parttbl' LIMIT 1").first.first
+      [{"name" => "parttbl PARTITION (p_low)",  "definition" => "RANGE (#{expression}) VALUES 100"},
+       {"name" => "parttbl PARTITION (p_high)", "definition" => "RANGE (#{expression}) VALUES MAXVALUE"}]
+    when 'postgresql'
+      [{"name" => "parttbl_high", "definition" => "RANGE (pri) FOR VALUES FROM (100) TO (MAXVALUE)"},
+       {"name" => "parttbl_low",  "definition" => "RANGE (pri) FOR VALUES FROM (MINVALUE) TO (100)"}]
+    end
+  end
 end